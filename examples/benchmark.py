@@ -0,0 +1,165 @@
+"""
+Compare the optimization engines on the bundled datasets
+
+    python benchmark.py [--datasets bse,crc,ecr] [--engines anneal,lahc,threshold,rrt]
+                        [--agents N] [--passes P] [--seed S]
+
+for each dataset the first week is planned with every engine (the agents
+rules are the same for all the engines) and the final energies and the
+optimization time are reported
+"""
+import re
+import json
+import time
+import argparse
+
+from random import randint, seed
+from functools import reduce
+from datetime import time as dtime
+from tabulate import tabulate
+
+from pywfplan import Shift, StaffPlanner
+
+
+R = Shift.fromSpec("R")
+
+
+def bse_planner(agents_n):
+    """
+    bse dataset: rest days from the agent cycle
+    """
+    with open("shifts_bse.json") as f:
+        shifts = [Shift.fromSpec(s[0], *s[1]) for s in json.load(f).items()]
+
+    with open("agents_bse.json") as f:
+        agents = dict(list(json.load(f).items())[:agents_n])
+
+    with open("target_bse.json") as f:
+        target = json.load(f)["week1"]
+
+    N = 3250 / (sum(target)*5/60) * len(agents) / 99
+    target = [t * N for t in target]
+
+    planner = StaffPlanner()
+    planner.setStaffingTarget(target, days=7, slot_length=5)
+
+    for code, agent in agents.items():
+        W = reduce(lambda a,b: a+b, [s for s in shifts if s.is_work() and s.attrs["contract"] == agent["contract"]])
+        days = [W] * 7
+        c = randint(0, 6)
+        days[(5 - c) % 7] = R
+        days[(6 - c) % 7] = R
+        planner.addAgentRule(code, reduce(lambda a,b: a*b, days))
+
+    return planner
+
+
+def crc_planner(agents_n):
+    """
+    crc dataset: start time windows during the week and on weekends
+    """
+    with open("shifts_crc.json") as f:
+        shifts = [Shift.fromSpec(*s) for s in json.load(f).items()]
+
+    with open("agents_crc.json") as f:
+        agents = dict(list(json.load(f).items())[:agents_n])
+
+    with open("target_crc.json") as f:
+        target = json.load(f)["week1"]
+
+    N = len(agents) / 194
+    target = [t * N for t in target]
+
+    def window(t0, t1):
+        t0 = dtime(hour=t0 // 60, minute=t0 % 60)
+        t1 = dtime(hour=t1 // 60, minute=t1 % 60)
+        return reduce(lambda a,b: a+b, [s for s in shifts if s.is_work() and t0 <= s.start_time() and s.start_time() <= t1])
+
+    planner = StaffPlanner()
+    planner.setStaffingTarget(target, days=7, slot_length=5)
+
+    for code, agent in agents.items():
+        W = window(agent["t0"] - 30, agent["t0"] + 30)
+        X = window(agent["t1"], agent["t2"])
+        planner.addAgentRule(code, W*W*W*W*W*X*R + W*W*W*W*W*R*X)
+
+    return planner
+
+
+def ecr_planner(agents_n):
+    """
+    ecr dataset: weekend, infra-week and split rest cycles
+    """
+    with open("shifts_ecr.json") as f:
+        shifts = [Shift.fromSpec(s[0], *s[1]) for s in json.load(f).items()]
+
+    with open("agents_ecr.json") as f:
+        agents = dict(list(json.load(f).items())[:agents_n])
+
+    with open("target_ecr.json") as f:
+        target = json.load(f)["week1"]
+
+    N = 4042.5 / (sum(target)*30/60) * len(agents) / 129
+    target = [t * N for t in target]
+
+    p = re.compile("^(\d\d):(\d\d)$")
+    def parse_time(s):
+        m = p.match(s)
+        return dtime(hour=int(m.group(1)), minute=int(m.group(2)))
+
+    planner = StaffPlanner()
+    planner.setStaffingTarget(target, days=7, slot_length=30)
+
+    for code, agent in agents.items():
+        t0, t1 = parse_time(agent["from"]), parse_time(agent["to"])
+        W = reduce(lambda a,b: a+b, [s for s in shifts if s.is_work() and s.attrs["contract"] == agent["contract"] and t0 <= s.start_time() and s.start_time() <= t1])
+
+        c = randint(0, 3)
+        if c == 0:
+            rule = W*W*W*W*W*R*R
+        elif c == 1 or c == 2:
+            rule = W*W*W*W*R*R*W + W*W*W*R*R*W*W + W*W*R*R*W*W*W + W*R*R*W*W*W*W + R*R*W*W*W*W*W
+        else:
+            rule = W*W*W*W*R*W*R + W*W*W*R*W*W*R + W*W*R*W*W*W*R + W*R*W*W*W*W*R + R*W*W*W*W*W*R
+        planner.addAgentRule(code, rule)
+
+    return planner
+
+
+DATASETS = {"bse": bse_planner, "crc": crc_planner, "ecr": ecr_planner}
+
+
+def energies(report):
+    """
+    Extract the final staffing, comfort and total energies from the report
+    """
+    def final(label):
+        m = re.search("^\s*{}: [-\d.]+ -> ([-\d.]+)$".format(label), report, re.MULTILINE)
+        return float(m.group(1)) if m is not None else None
+
+    return final("staffing energy"), final("comfort energy"), final("TOTAL ENERGY")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="compare the optimization engines on the bundled datasets")
+    parser.add_argument("--datasets", default="bse,crc,ecr")
+    parser.add_argument("--engines", default="anneal,lahc,threshold,rrt")
+    parser.add_argument("--agents", type=int, default=1000)
+    parser.add_argument("--passes", type=int, default=20)
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    rows = []
+    for dataset in args.datasets.split(","):
+        for engine in args.engines.split(","):
+            # same agents rules for every engine
+            seed(args.seed)
+            planner = DATASETS[dataset](args.agents)
+
+            t0 = time.time()
+            planner.run(annealing_schedule=0.9, comfort_energy_weight=0.1, engine=engine, engine_passes=args.passes)
+            elapsed = time.time() - t0
+
+            rows.append([dataset, engine, *energies(planner.getReport()), elapsed])
+
+    print(tabulate(rows, headers=["dataset", "engine", "staffing", "comfort", "total", "time (s)"], floatfmt=".4f"))
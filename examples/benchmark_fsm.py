@@ -0,0 +1,68 @@
+"""
+Compare the fsm backends on some rule families
+
+    python benchmark_fsm.py [--size N] [--samples S]
+
+for each rule the automaton is compiled with the Brzozowski backend
+(derivatives), eagerly and lazily, and with the Antimirov backend (partial
+derivatives, always lazy), the number of states (built by the samples
+when lazy), the compile time and the time of the first samples are
+reported
+"""
+import time
+import argparse
+
+from functools import reduce
+from tabulate import tabulate
+
+from pywfplan import Re, Fsm
+
+
+def rules(n):
+    """
+    Rule families over early, late, night and rest days (n days)
+    """
+    E, L, N, R = Re("E"), Re("L"), Re("N"), Re("R")
+    W = E + L + N
+    D = W + R
+
+    def power(r, k):
+        return reduce(lambda a, b: a * b, [r] * k) if k > 0 else None
+
+    def at_most(r, other, k):
+        # words over r and other with at most k r
+        o = other.kstar()
+        return reduce(lambda a, b: a + b, [o] + [o * power(r * o, i) for i in range(1, k + 1)])
+
+    days = power(D, n)
+    work = at_most(W, R, n * 5 // 7)
+    late = at_most(L, E + N + R, n // 3)
+    night = at_most(N, E + L + R, n // 4)
+
+    a, b = Re("a"), Re("b")
+
+    return {"days & work": days & work,
+            "days & work & late": days & work & late,
+            "days & work & late & night": days & work & late & night,
+            "(a+b)* a (a+b)^{}".format(n): (a + b).kstar() * a * power(a + b, n),
+            "((ab+a)* (b+aa)*)^3": power((a * b + a).kstar() * (b + a * a).kstar(), 3)}
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="compare the fsm backends")
+    parser.add_argument("--size", type=int, default=7)
+    parser.add_argument("--samples", type=int, default=100)
+    args = parser.parse_args()
+
+    rows = []
+    for name, rule in rules(args.size).items():
+        for backend in ["brzozowski", "antimirov"]:
+            for lazy in ([False, True] if backend == "brzozowski" else [True]):
+                t0 = time.time()
+                fsm = Fsm(rule, lazy=lazy, backend=backend)
+                t1 = time.time()
+                fsm.samples(args.samples)
+                t2 = time.time()
+                rows.append([name, backend, "lazy" if lazy else "eager", fsm.states(), (t1 - t0) * 1000, (t2 - t1) * 1000])
+
+    print(tabulate(rows, headers=["rule", "backend", "mode", "states", "compile (ms)", "samples (ms)"], floatfmt=".2f"))
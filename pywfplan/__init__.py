@@ -2,5 +2,6 @@ from .fsm import Fsm
 from .shift import Shift
 from .pywfplan_ext import Re
 from .staff_planner import StaffPlanner
+from .scoring import scorePlans
 
-__all__ = ["Shift", "StaffPlanner", "Re", "Fsm"]
+__all__ = ["Shift", "StaffPlanner", "Re", "Fsm", "scorePlans"]
@@ -1,17 +1,29 @@
 import graphviz
-from .pywfplan_ext import Re, FsmExt
+from .pywfplan_ext import Re, FsmExt, Backend
 
 class Fsm(FsmExt):
     """
     Wrapper class over C++ implementation of a finite state machine
     """
 
-    def __init__(self, regexp : Re):
+    def __init__(self, regexp : Re, lazy : bool = False, backend : str = "brzozowski"):
         """
         Create a new finite state machine compiling the regexp with Brzozowski
-        algorithm
+        algorithm (derivatives) or Antimirov algorithm (partial derivatives,
+        the machine is the nfa determinised on demand, it is always lazy)
+
+        A lazy machine builds its states when the sampling first visits them
+        """
+        super().__init__(regexp, lazy, getattr(Backend, backend))
+
+
+    def setWeights(self, weights : dict):
+        """
+        Sample the letters leaving a state in proportion to their weights (the
+        letters not given weigh 1), an empty dictionary restores the default
+        equi-probable letters
         """
-        super().__init__(regexp)
+        super().setWeights(list(weights.keys()), list(weights.values()))
 
 
     def samples(self, n=10):
@@ -0,0 +1,26 @@
+from typing import Dict, List
+from .shift import Shift
+from .pywfplan_ext import TargetExt, scorePlans as _scorePlans
+
+
+def scorePlans(plans : List[List[List[int]]], shifts : List[Shift], target, days : int = 7, slot_length : int = 15, weights = None, week : int = 0) -> List[Dict]:
+    """
+    Score plans built elsewhere (manual edits, previous releases, ...) with the
+    planner energies
+
+    Each plan is a matrix of shift indices in the shifts list with one row per
+    agent and one column per day, the target (and the optional staffing error
+    weights) are given as for the planner. For each plan get the staffing and
+    comfort energies of the week and the energy of each day
+
+    Plans are scored in parallel
+    """
+    trg = TargetExt(slot_length, days, target)
+
+    if weights is not None:
+        trg.setWeights(weights)
+
+    return [{"staffing_energy": s.staffing_energy,
+             "comfort_energy": s.comfort_energy,
+             "day_energies": s.day_energies}
+            for s in _scorePlans(trg, [s.shift() for s in shifts], plans, week)]
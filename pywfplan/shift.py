@@ -26,6 +26,46 @@ def parse_shift_spec(spans : str = ""):
     return [parse_interval(s) for s in spans.split(",")]
 
 
+def parse_break_spec(breaks : str = ""):
+    """
+    Parse a flexible break specification line of the form
+
+    '12:00-15:00/60, 16:00-18:00/15, ...'
+
+    each break of the given length in minutes is placed inside its window
+    """
+    if breaks.replace(" ", "") == "":
+        return []
+
+    p = re.compile("^(\d\d):(\d\d)-(\d\d):(\d\d)/(\d+)$")
+    def parse_break(s):
+        m = p.match(s.replace(" ", ""))
+        if m is not None:
+            t0 = int(m.group(1))*60 + int(m.group(2))
+            t1 = int(m.group(3))*60 + int(m.group(4))
+            return [t0, t1, int(m.group(5))]
+        else:
+            raise Exception("invalid break specification {}".format(s))
+
+    return [parse_break(s) for s in breaks.split(",")]
+
+
+def parse_shift_flags(attrs : Dict = {}):
+    """
+    Extract the shift flags from the attributes, the following boolean
+    attributes are recognized:
+
+    'late'  : a late shift
+    'night' : a night shift
+    """
+    flags = 0
+    if attrs.get("late", False):
+        flags |= ShiftExt.FLAG_LATE
+    if attrs.get("night", False):
+        flags |= ShiftExt.FLAG_NIGHT
+    return flags
+
+
 class Shift(ShiftRule):
     """
     The shift class represents the work that can be assigned to an agent
@@ -62,15 +102,24 @@ class Shift(ShiftRule):
 
 
     @classmethod
-    def fromSpec(cls, code : str, spec : str = "", attrs : Dict = {}):
+    def fromSpec(cls, code : str, spec : str = "", attrs : Dict = {}, breaks : str = ""):
         """
         Create a shift with a code and a specification line like
 
         '09:00-12:00, 15:30-19:30'
 
         If no specification is given the shift is assumed to be a rest shift
+
+        The 'late' and 'night' attributes flag burdensome shifts that are
+        spread fairly by the fairness energy
+
+        Flexible breaks are given as windows with a length like
+
+        '12:00-15:00/60'
+
+        and are placed by the planner where they hurt staffing the least
         """
-        return cls(ShiftExt(code, parse_shift_spec(spec)), attrs)
+        return cls(ShiftExt(code, parse_shift_spec(spec), parse_shift_flags(attrs), parse_break_spec(breaks)), attrs)
 
 
     def is_work(self):
@@ -1,4 +1,4 @@
-from typing import List
+from typing import Dict, List, Tuple
 from .pywfplan_ext import ShiftRule, PlanExt, TargetExt, StaffPlannerExt
 
 
@@ -10,14 +10,26 @@ class StaffPlanner:
     def __init__(self):
         self.offset_ = 0
         self.agents_ = {}
+        self.contracts_ = {}
+        self.teams_ = {}
+        self.backends_ = {}
+        self.availability_ = {}
         self.target_ = None
         self.result_ = None
         self.report_ = None
+        self.rules_ = None
+        self.lazy_ = (False, 0)
+        self.weights_ = {}
 
 
-    def addAgentRule(self, code : str, rule : ShiftRule):
+    def addAgentRule(self, code : str, rule : ShiftRule, contract_hours : float = None, team : str = None, backend : str = "brzozowski"):
         """
-        Specify a shift assignment rule for the agent
+        Specify a shift assignment rule for the agent and optionally its weekly
+        contract hours and its team
+
+        The rule is compiled with the 'brzozowski' backend (derivatives) or the
+        'antimirov' backend (partial derivatives, always built lazily) which
+        may be faster for rules combining intersections and long products
         """
         rule_offset = max([s.t1() for s in rule.shifts()]) - 24*60
 
@@ -25,24 +37,135 @@ class StaffPlanner:
             self.offset_ = rule_offset
 
         self.agents_[code] = rule
+        self.backends_[code] = backend
+
+        if contract_hours is not None:
+            self.contracts_[code] = contract_hours
+
+        if team is not None:
+            self.teams_[code] = team
+
+
+    def setAgentAvailability(self, code : str, day : int, shifts : List[str]):
+        """
+        Restrict the shifts (given by code) the agent can be assigned on a day
+        of the plan, an empty list removes the restriction
+
+        The availability does not change the agent rule, it can be updated
+        between runs
+        """
+        if code not in self.agents_:
+            raise Exception("the agent has no rule")
+
+        if shifts:
+            self.availability_.setdefault(code, {})[day] = list(shifts)
+        else:
+            self.availability_.get(code, {}).pop(day, None)
+
+
+    def setAgentTimeOff(self, code : str, days : List[int]):
+        """
+        Give the agent time off (holidays, sick days) on some days of the plan:
+        only the rest shifts of its rule can be assigned on those days
+        """
+        if code not in self.agents_:
+            raise Exception("the agent has no rule")
+
+        rest = [s.code() for s in self.agents_[code].shifts() if not s.work()]
+        if not rest:
+            raise Exception("the agent rule has no rest shift")
+
+        for day in days:
+            self.setAgentAvailability(code, day, rest)
+
+
+    def setLazySamplers(self, lazy : bool = True, warmup : int = 0):
+        """
+        Build the states of the agents samplers when the sampling first visits
+        them, after a warm-up of some transitions from the start (the minimum
+        rest and the availability build the whole samplers)
+
+        The start-up of rules with very large automata becomes immediate
+        """
+        self.lazy_ = (lazy, warmup)
+
+
+    def setShiftWeights(self, weights : Dict[str, float]):
+        """
+        Sample the shifts of the agents rules in proportion to their weights
+        by code (e.g. computed from the shifts attrs), the shifts not given
+        weigh 1 and an empty dictionary restores the default equi-probable
+        shift classes
+        """
+        if any(w <= 0 for w in weights.values()):
+            raise Exception("shift weights must be positive")
+
+        self.weights_ = dict(weights)
 
 
-    def setStaffingTarget(self, target, days : int = 7, slot_length : int = 15):
+    def setStaffingTarget(self, target, days : int = 7, slot_length : int = 15, minimum = None, weights = None, scenarios = None, scenarios_lambda : float = 1.0):
         """
-        Set target staffing
+        Set target staffing and optionally the minimum staffing (with the
+        same slot length)
+
+        The staffing error can be weighted either with a curve having the same
+        slot length or with a day of week hourly profile of 7 * 24 values
+
+        Demand scenarios (perturbed target curves with the same slot length)
+        are used by the robust energy: the mean plus lambda times the standard
+        deviation of the staffing energy over the scenarios
         """
         self.target_ = TargetExt(slot_length, days, target)
 
+        if minimum is not None:
+            self.target_.setMinimum(minimum)
+
+        if weights is not None:
+            self.target_.setWeights(weights)
+
+        if scenarios is not None:
+            self.target_.setScenarios(scenarios, scenarios_lambda)
 
-    def run(self, annealing_schedule : float = 0.9, comfort_energy_weight : float =0.2):
+
+    def run(self, annealing_schedule : float = 0.9, comfort_energy_weight : float =0.2, deviation_energy_weight : float = 0.0, contract_energy_weight : float = 0.0, fairness_energy_weight : float = 0.0, minimum_rest : int = 0, population : int = 0, generations : int = 20, engine : str = "anneal", engine_passes : int = 20, engine_parameter : float = 0.0, repair_agents : int = 0, robust_energy_weight : float = 0.0, cold_acceptance : float = 0.0):
         """
         Run optimization
-        """
-        plan = PlanExt(self.offset_, self.agents_.keys(), self.target_)
-        staff_planner = StaffPlannerExt("", plan, annealing_schedule, comfort_energy_weight)
 
-        for code, rule in self.agents_.items():
-            staff_planner.setAgentSampler(code, rule)
+        The deviation energy penalizes the worst understaffing and the slots
+        below the minimum staffing, the contract energy penalizes the
+        difference between worked and contract hours, the fairness energy
+        penalizes the uneven spread of weekend and late shifts within teams
+
+        The minimum rest (in minutes) between shifts on consecutive days is
+        enforced by the samplers
+
+        With a population of at least 2 plans the annealing is replaced by an
+        evolutionary search: plans exchange agent lines (or team blocks) and
+        each offspring is refined by a short annealing walk
+
+        The engine is either simulated annealing ('anneal') or a local search
+        without temperature calibration: late acceptance hill climbing
+        ('lahc'), threshold accepting ('threshold') or record-to-record travel
+        ('rrt') running for some passes, the engine parameter (history length,
+        initial threshold or deviation ratio) has a default when not positive
+
+        With some repair agents, after each annealing step a day is freed for
+        that many agents and their shifts are re-assigned jointly against the
+        residual staffing
+
+        The robust energy (it needs demand scenarios in the staffing target)
+        penalizes the plans whose staffing error is large or uncertain across
+        the scenarios
+
+        When the acceptance ratio of an annealing step falls below the cold
+        acceptance the following steps are rejection-free: single day shift
+        changes are drawn with probability proportional to their acceptance
+        """
+        staff_planner = self._createPlanner(annealing_schedule, comfort_energy_weight, deviation_energy_weight, contract_energy_weight, fairness_energy_weight, minimum_rest, repair_agents)
+        staff_planner.setRobustWeight(robust_energy_weight)
+        staff_planner.setColdPhase(cold_acceptance)
+        staff_planner.setEvolution(population, generations)
+        staff_planner.setEngine(engine, engine_passes, engine_parameter)
 
         staff_planner.run()
 
@@ -50,6 +173,109 @@ class StaffPlanner:
         self.report_ = staff_planner.getReport()
 
 
+    def sweep(self, comfort_energy_weights : List[float], annealing_schedule : float = 0.9, deviation_energy_weight : float = 0.0, contract_energy_weight : float = 0.0, fairness_energy_weight : float = 0.0, minimum_rest : int = 0, repair_agents : int = 0) -> List[Dict]:
+        """
+        Run the optimization for several comfort energy weights in parallel
+        (each point starting from the plan of its neighbour) and get the non
+        dominated points as dictionaries with the comfort weight, the staffing
+        and comfort energies, the optimization time in seconds and the agents
+        plans
+
+        The planner result is not changed
+        """
+        staff_planner = self._createPlanner(annealing_schedule, 0.0, deviation_energy_weight, contract_energy_weight, fairness_energy_weight, minimum_rest, repair_agents)
+
+        return [{"comfort_weight": p.comfort_weight,
+                 "staffing_energy": p.staffing_energy,
+                 "comfort_energy": p.comfort_energy,
+                 "seconds": p.seconds,
+                 "plan": {code: [s.code() for s in p.plan.getAgentPlan(code)] for code in self.agents_}}
+                for p in staff_planner.sweep(comfort_energy_weights)]
+
+
+    def sizing(self, classes : Dict[str, List[str]], threshold : float = 0.95, annealing_schedule : float = 0.9, comfort_energy_weight : float = 0.2, deviation_energy_weight : float = 0.0, contract_energy_weight : float = 0.0, fairness_energy_weight : float = 0.0, minimum_rest : int = 0, repair_agents : int = 0) -> Dict[str, int]:
+        """
+        Find the minimum number of agents of each class (e.g. contract) for
+        the weekly coverage of the target staffing to reach the threshold
+
+        In each class the first agents are kept, the others rest all the week.
+        The sized plan becomes the planner result and the probes are listed
+        in the report
+        """
+        staff_planner = self._createPlanner(annealing_schedule, comfort_energy_weight, deviation_energy_weight, contract_energy_weight, fairness_energy_weight, minimum_rest, repair_agents)
+
+        agents = [code for c in classes.values() for code in c]
+        labels = [label for label, c in classes.items() for code in c]
+
+        headcount = staff_planner.sizing(agents, labels, threshold)
+
+        self.result_ = staff_planner.getPlan()
+        self.report_ = staff_planner.getReport()
+
+        return headcount
+
+
+    def _createPlanner(self, annealing_schedule, comfort_energy_weight, deviation_energy_weight, contract_energy_weight, fairness_energy_weight, minimum_rest, repair_agents):
+        """
+        Create the planner extension with the agents samplers
+        """
+        plan = PlanExt(self.offset_, self.agents_.keys(), self.target_)
+
+        for code, hours in self.contracts_.items():
+            plan.setAgentContract(code, hours)
+
+        for code, team in self.teams_.items():
+            plan.setAgentTeam(code, team)
+
+        staff_planner = StaffPlannerExt("", plan, annealing_schedule, comfort_energy_weight)
+        staff_planner.setDeviationWeight(deviation_energy_weight)
+        staff_planner.setContractWeight(contract_energy_weight)
+        staff_planner.setFairnessWeight(fairness_energy_weight)
+        staff_planner.setMinimumRest(minimum_rest)
+        staff_planner.setRepairSize(repair_agents)
+        staff_planner.setLazySamplers(*self.lazy_)
+        staff_planner.setShiftWeights(list(self.weights_.keys()), list(self.weights_.values()))
+
+        self.rules_ = [{"rule": r.rule, "backend": r.backend, "precompiled": r.precompiled, "agents": r.agents, "states": r.states, "transitions": r.transitions, "seconds": r.seconds}
+                       for r in staff_planner.setAgentSamplers(list(self.agents_.keys()), list(self.agents_.values()), [self.backends_[code] for code in self.agents_])]
+
+        for code, days in self.availability_.items():
+            for day, shifts in days.items():
+                staff_planner.setAgentAvailability(code, day, shifts)
+
+        return staff_planner
+
+
+    def scoreScenarios(self, scenarios, percentiles : Tuple[float, ...] = (50, 90, 95), week : int = 0) -> Dict:
+        """
+        Score the optimized plan week against demand scenarios (perturbed
+        target curves with the target slot length and length), get the
+        staffing energy of each scenario, their mean, standard deviation and
+        percentiles
+        """
+        if self.result_ is None:
+            raise Exception("the plan has not been optimized yet")
+
+        energies = self.result_.scenarioEnergies(week, [self.target_.resample(s) for s in scenarios])
+        if not energies:
+            raise Exception("there must be some scenarios")
+
+        n = len(energies)
+        mean = sum(energies) / n
+        stddev = (sum((e - mean)**2 for e in energies) / n)**0.5
+
+        def percentile(p):
+            s = sorted(energies)
+            k = (n - 1) * p / 100
+            i = min(int(k), n - 2) if n > 1 else 0
+            return s[i] + (s[min(i + 1, n - 1)] - s[i]) * (k - i)
+
+        return {"energies": energies,
+                "mean": mean,
+                "stddev": stddev,
+                "percentiles": {p: percentile(p) for p in percentiles}}
+
+
     def getAgentPlan(self, agent_code : str) -> List[str]:
         """
         Get the optimized plan for agent
@@ -60,6 +286,17 @@ class StaffPlanner:
         return [s.code() for s in self.result_.getAgentPlan(agent_code)]
 
 
+    def getAgentBreaks(self, agent_code : str) -> List[List[Tuple[int, int]]]:
+        """
+        Get the placed flexible breaks for agent, for each day a list of
+        (start, end) times in minutes
+        """
+        if self.result_ is None:
+            raise Exception("the plan has not been optimized yet")
+
+        return [list(s.breaks()) for s in self.result_.getAgentPlan(agent_code)]
+
+
     def getTargetStaffing(self) -> List[float]:
         """
         Get the optimized staffing curve
@@ -80,6 +317,19 @@ class StaffPlanner:
         return self.result_.getPlannedStaffing()
 
 
+    def getRulesReport(self) -> List[Dict]:
+        """
+        Get for each unique agent rule of the last run its backend, whether it
+        was compiled ahead of time (see tools/compile_rules.py), the number of
+        agents, the size of its automaton (states and transitions) and its
+        compile time in seconds (the rules are compiled in parallel)
+        """
+        if self.rules_ is None:
+            raise Exception("the planner has not been run yet")
+
+        return self.rules_
+
+
     def getReport(self) -> str:
         """
         Get optimization report
@@ -1,8 +1,14 @@
+import os
 import sys
 from setuptools import setup, Extension
 
 VERSION = "0.5.12"
 
+# rules compiled ahead of time for a site build (see tools/compile_rules.py)
+define_macros = []
+if "PYWFPLAN_RULES" in os.environ:
+    define_macros.append(("PYWFPLAN_RULES", '"{}"'.format(os.path.abspath(os.environ["PYWFPLAN_RULES"]))))
+
 pywfplan_ext = Extension("pywfplan.pywfplan_ext",
 
                          sources=["src/shift.cpp",
@@ -17,7 +23,11 @@ pywfplan_ext = Extension("pywfplan.pywfplan_ext",
 
                          library_dirs=["/usr/local/lib"],
 
-                         extra_compile_args=["-std=c++17"])
+                         define_macros=define_macros,
+
+                         extra_compile_args=["-std=c++17", "-pthread", "-fopenmp-simd"],
+
+                         extra_link_args=["-pthread"])
 
 setup(name="pywfplan",
 
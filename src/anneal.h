@@ -4,10 +4,31 @@
 #include <iomanip>
 #include <iostream>
 #include <random>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "sum_tree.h"
 
 namespace anneal
 {
+  //! Check whether a state implements the large neighbourhood move
+  template <typename S, typename = void>
+  struct has_repair : std::false_type
+  {
+  };
+
+  template <typename S>
+  struct has_repair<S, std::void_t<decltype(std::declval<S &>().repair())>> : std::true_type
+  {
+  };
+
   //! Simulated annealing algorithm over a state
+  /*! The state provides mutate, delta_energy, apply_mutation, energy,
+   *  the best plan marks and the indexed moves of the cold phase, a
+   *  repair method (the large neighbourhood move) is optional and is
+   *  called after each annealing step when present.
+   */
   template <typename S>
   class Anneal
   {
@@ -16,12 +37,23 @@ namespace anneal
       : rne_{}
       , urd_{0.0, 1.0}
       , nover_{nover}
+      , cold_{0.0}
       , state_{state}
     {
       std::random_device device;
       rne_.seed((static_cast<uint64_t>(device()) << 32) | device());
     };
 
+    //! Enable the rejection-free cold phase
+    /*! Once the acceptance ratio of an annealing step falls below the
+     *  threshold, the following steps use the n-fold way over the
+     *  single day moves indexed by the state (0 disables it).
+     */
+    void setColdPhase(double acceptance)
+    {
+      cold_ = acceptance;
+    };
+
     //! Calibrate initial temperature
     double calibrateTi()
     {
@@ -73,7 +105,29 @@ namespace anneal
       return de_min;
     };
 
+    //! Perform n Metropolis steps at constant temperature
+    /*! Return the number of accepted mutations
+     */
+    unsigned int sweep(double temp, unsigned int n)
+    {
+      unsigned int a = 0;
+      for (unsigned int k = 0; k < n; k++)
+        {
+          state_.mutate();
+          if (metropolis(state_.delta_energy(), temp))
+            {
+              state_.apply_mutation();
+              a++;
+            }
+        }
+      return a;
+    };
+
     //! Perform annealing
+    /*! The best visited plan is marked on the state whenever the energy
+     *  improves and restored at the end if the annealing finished above
+     *  it.
+     */
     void anneal(double ti, double tf, double delta_t)
     {
       if (ti <= 0)
@@ -87,6 +141,7 @@ namespace anneal
 
       double temp   = ti;
       double e      = state_.energy();
+      double best   = e;
       unsigned int   steps  = static_cast<uint>(round((log(tf) - log(ti)) / log(delta_t)));
       unsigned int   nlimit = nover_ / 50;
 
@@ -98,40 +153,64 @@ namespace anneal
         << std::setprecision(4) << delta_t << ") ..."
         << "\n"
         << std::flush;
+      state_.mark_best();
+      bool cold = false;
       for (unsigned int n = 1; n <= steps; n++)
         {
           unsigned int l = 0;
           unsigned int k = 0;
-          for (k = 0; k < nover_; k++)
-            {
-              // mutate configuration
-              state_.mutate();
-              // compute delta energy
-              double de = state_.delta_energy();
-              if (metropolis(de, temp))
-                {
-                  // apply mutation to current configuration
-                  state_.apply_mutation();
-                  e += de;
-                  l++;
-                }
-              if (l > nlimit) break;
-            }
+          // rejection-free moves in the cold phase, Metropolis otherwise
+          if (cold)
+            l = nfold(temp, nlimit, e, best, k);
+          else
+            for (k = 0; k < nover_; k++)
+              {
+                // mutate configuration
+                state_.mutate();
+                // compute delta energy
+                double de = state_.delta_energy();
+                if (metropolis(de, temp))
+                  {
+                    // apply mutation to current configuration
+                    state_.apply_mutation();
+                    e += de;
+                    l++;
+                    improve(e, best);
+                  }
+                if (l > nlimit) break;
+              }
+          // large neighbourhood move (when implemented by the state)
+          if constexpr (has_repair<S>::value)
+            state_.repair();
+
           // fix final energy to avoid accumulation of numerical errors in de
           e = state_.energy();
+          improve(e, best);
 
           std::cout
             << std::setw(3) << (100 * n / steps) << "%"
             << " T=" << std::fixed << std::setprecision(4) << temp
             << " E=" << std::fixed << std::setprecision(4) << e
-            << " (" << l << " " << k << ") ..."
+            << " (" << l << " " << k << ")" << (cold ? " rejection-free" : "") << " ..."
             << "\n"
             << std::flush;
 
+          if (!cold && cold_ > 0.0 && state_.indexable() && l < cold_ * k)
+            cold = true;
+
           temp *= delta_t;
           if (l < 10)
             break;
         }
+
+      if (best < e)
+        {
+          state_.restore_best();
+          std::cout
+            << "restored best energy " << std::fixed << std::setprecision(4) << state_.energy()
+            << " (final " << std::fixed << std::setprecision(4) << e << ")\n"
+            << std::flush;
+        }
     };
 
   private:
@@ -143,11 +222,81 @@ namespace anneal
     std::uniform_real_distribution<double> urd_;
 
     unsigned int nover_;
+    double       cold_;
     S &          state_;
 
     inline bool metropolis(double delta, double temp)
     {
       return delta < 0.0 || urd_(rne_) < exp(-delta / temp);
     };
+
+    // mark the best plan when the tracked energy improves on it, the
+    // deltas are exact and the tracked energy is resynced with the state
+    // energy at the end of each step only
+    void improve(double e, double &best)
+    {
+      if (e >= best) return;
+      state_.mark_best();
+      best = e;
+    };
+
+    // Metropolis acceptance probability of an indexed move
+    static double rate(double delta, double temp)
+    {
+      if (std::isinf(delta)) return 0.0;
+      return delta <= 0.0 ? 1.0 : exp(-delta / temp);
+    };
+
+    // rejection-free step: moves are drawn with probability proportional
+    // to their acceptance and always applied, the clock counts the single
+    // day proposals a Metropolis walk would have needed (n / total rate,
+    // n the moves of finite delta);
+    // return the applied moves and set k to the clock
+    unsigned int nfold(double temp, unsigned int nlimit, double &e, double &best, unsigned int &k)
+    {
+      const size_t      n = state_.index_moves();
+      sum_tree::SumTree tree{static_cast<unsigned int>(n)};
+      std::vector<bool> finite(n, false);
+      double            valid = 0.0;
+      for (size_t m = 0; m < n; m++)
+        {
+          double de = state_.move_delta(m);
+          if (std::isinf(de)) continue;
+          tree.assign(m, rate(de, temp));
+          finite[m] = true;
+          valid += 1.0;
+        }
+      tree.rebuild();
+
+      std::vector<size_t> changed;
+      unsigned int        l     = 0;
+      double              clock = 0.0;
+      while (l <= nlimit && clock < nover_ && tree.total() > 0.0)
+        {
+          clock += valid / tree.total();
+          size_t m = tree.find(urd_(rne_) * tree.total());
+          if (tree.value(m) <= 0.0) break;
+
+          double de = state_.move_delta(m);
+          changed.clear();
+          state_.apply_move(m, changed);
+          for (size_t c : changed)
+            {
+              double dc = state_.move_delta(c);
+              tree.set(c, rate(dc, temp));
+              if (finite[c] == std::isinf(dc))
+                {
+                  finite[c] = !finite[c];
+                  valid += finite[c] ? 1.0 : -1.0;
+                }
+            }
+
+          e += de;
+          l++;
+          improve(e, best);
+        }
+      k = static_cast<unsigned int>(std::min<double>(clock, nover_));
+      return l;
+    };
   };
 }
@@ -9,3 +9,21 @@ constexpr unsigned int SLOTS_DAY = 24 * 60 / SLOT_LENGTH;
 
 // Annealing iteration limit for each agent day
 const unsigned int NOVER = 100;
+
+// Default late acceptance history length
+const unsigned int LAHC_LENGTH = 2000;
+
+// Default threshold accepting initial threshold (relative to energy)
+const double THRESHOLD_RATIO = 0.01;
+
+// Default record-to-record travel deviation (relative to record)
+const double RECORD_RATIO = 0.005;
+
+// Best response rounds of the large neighbourhood repair
+const unsigned int REPAIR_ROUNDS = 5;
+
+// Minimum agents per thread when the staffing is rebuilt from the plan
+const unsigned int STAFFING_BLOCK = 64;
+
+// Minimum points of each warm started chain of the comfort weight sweep
+const unsigned int SWEEP_CHAIN = 4;
@@ -1,8 +1,15 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <functional>
+#include <limits>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
 #include <random>
 #include <set>
 #include <sstream>
@@ -20,6 +27,145 @@ namespace fsm
     unsigned int operator()(const T &) { return 1; };
   };
 
+  //! Sampling weight of a letter (see Fsm::setWeights)
+  template <typename T>
+  using weight_t = std::function<double(const T &)>;
+
+  //! Walker alias table
+  /*! Draws an index in proportion to its weight with a single uniform
+   *  number u in [0, n): the slot ⌊u⌋ is kept if the fraction of u is
+   *  below its probability, otherwise its alias is drawn. The table is
+   *  built in linear time filling the slots below the mean weight with
+   *  the excess of the ones above it.
+   */
+  class alias_t
+  {
+  public:
+    alias_t(){};
+
+    alias_t(const std::vector<double> &weights)
+      : prob_(weights.size(), 1.0)
+      , alias_(weights.size())
+    {
+      const size_t        n     = weights.size();
+      const double        total = std::accumulate(weights.begin(), weights.end(), 0.0);
+      std::vector<double> p(n);
+      std::vector<size_t> small, large;
+      for (size_t i = 0; i < n; i++)
+        {
+          alias_[i] = static_cast<unsigned int>(i);
+          p[i]      = weights[i] * static_cast<double>(n) / total;
+          (p[i] < 1.0 ? small : large).push_back(i);
+        }
+      while (!small.empty() && !large.empty())
+        {
+          size_t i = small.back();
+          size_t j = large.back();
+          small.pop_back();
+          prob_[i]  = p[i];
+          alias_[i] = static_cast<unsigned int>(j);
+          p[j] -= 1.0 - p[i];
+          if (p[j] < 1.0)
+            {
+              large.pop_back();
+              small.push_back(j);
+            }
+        }
+      // the slots left over by the rounding keep probability 1
+    };
+
+    //! Draw an index
+    template <typename R>
+    size_t draw(R &rne) const
+    {
+      if (prob_.size() < 2) return 0;
+      const double u = std::uniform_real_distribution<double>{0.0, static_cast<double>(prob_.size())}(rne);
+      const size_t i = std::min(static_cast<size_t>(u), prob_.size() - 1);
+      return u - static_cast<double>(i) < prob_[i] ? i : alias_[i];
+    };
+
+  private:
+    std::vector<double>       prob_;
+    std::vector<unsigned int> alias_;
+  };
+
+  //! Fsm construction backend
+  enum class backend_t
+  {
+    brzozowski, //!< a state for each derivative of the regexp
+    antimirov   //!< a state for each set of partial derivatives (nfa states), built lazily
+  };
+
+  //! Backend from its name
+  inline backend_t to_backend(const std::string &name)
+  {
+    if (name == "brzozowski") return backend_t::brzozowski;
+    if (name == "antimirov") return backend_t::antimirov;
+    throw std::invalid_argument{"unknown fsm backend (must be brzozowski or antimirov)"};
+  };
+
+  //! Transitions of an fsm compiled ahead of time
+  /*! The tables are constexpr arrays generated by tools/compile_rules.py
+   *  (see Fsm::print_compiled). The states are numbered from 1 (0 is the
+   *  dead state) and only the transitions from which a final state can
+   *  be reached are kept. They are grouped as the sampling maps of Fsm:
+   *
+   *  - the successors of state q are the (state, first part) pairs
+   *    succ[first[q]] ... succ[first[q + 1] - 1]
+   *  - the letters leading to the successor s are split in the Epp
+   *    partitions succ[s][1] ... succ[s + 1][1] - 1
+   *  - the letters of the partition p are lts[parts[p]] ... lts[parts[p + 1] - 1]
+   *
+   *  succ and parts end with a sentinel entry.
+   */
+  struct compiled_t
+  {
+    size_t              hash;      //!< hash of the compiled regexp
+    backend_t           backend;   //!< backend of the compilation
+    const char *        name;      //!< rule name
+    const char *        rule;      //!< compiled regexp (as printed)
+    unsigned int        states;    //!< number of states
+    unsigned int        letters_n; //!< number of letters
+    const char *const * letters;   //!< letters (as printed)
+    const bool *        finals;    //!< final flag of each state
+    const unsigned int *first;     //!< first successor of each state
+    const unsigned int (*succ)[2]; //!< successor and its first partition
+    const unsigned int *parts;     //!< first letter of each partition
+    const unsigned int *lts;       //!< letters of the partitions
+  };
+
+  // tables registered by the generated headers included in the build
+  inline std::vector<const compiled_t *> &compiled_tables()
+  {
+    static std::vector<const compiled_t *> tables;
+    return tables;
+  };
+
+  //! Register the tables of a generated header
+  inline bool register_compiled(const compiled_t &c)
+  {
+    compiled_tables().push_back(&c);
+    return true;
+  };
+
+  //! Tables compiled ahead of time for a regexp, null if there are none
+  /*! The tables are looked up by hash and backend, the printed regexp
+   *  must then match the compiled one (otherwise the regexp is left to
+   *  the run-time compilation).
+   */
+  template <typename T>
+  inline const compiled_t *find_compiled(const regexp::RegExp<T> &r, backend_t backend)
+  {
+    std::string rule;
+    for (const auto *c : compiled_tables())
+      if (c->hash == r.hash() && c->backend == backend)
+        {
+          if (rule.empty()) rule = r.to_string();
+          if (rule == c->rule) return c;
+        }
+    return nullptr;
+  };
+
   //! Finite State Machine
   /*! In order to generate the *minimal* DFA for a given regular
    *  expression we repeatedly derive the regexp with respect to each
@@ -29,6 +175,23 @@ namespace fsm
    *  - each letter used in the derivative with a **transition**
    *
    *  The resulting fsm is *minimal*.
+   *
+   *  A lazy fsm derives the regexp of a state the first time the state
+   *  is visited by a walk, the states are memoised in a table shared
+   *  by the copies of the fsm. The walks only step into the states from
+   *  which a final state can be reached, found by a breadth first
+   *  search over the derivatives.
+   *
+   *  The Antimirov backend derives the partial derivatives instead, the
+   *  fsm is the subset construction of the linear size nfa whose states
+   *  are the partial derivatives. It is not minimal but the products
+   *  and intersections do not nest sums of derivatives, which may blow
+   *  up the number of distinct derivatives. The subset construction is
+   *  always lazy: only the subsets visited by the walks are built (the
+   *  whole fsm still is by constrain, setMask and print).
+   *
+   *  The letters are sampled with per-transition alias tables over the
+   *  letter weights, Epp is the default weight source (see setWeights).
    */
   template <typename T, typename Epp = default_epp<T>>
   class Fsm
@@ -38,7 +201,19 @@ namespace fsm
 
     //! Use regexp derivatives to build the fsm
     Fsm(const regexp::RegExp<T> &r)
+      : Fsm{r, false} {};
+
+    //! Use regexp derivatives to build the fsm (on demand when lazy)
+    /*! The states of a lazy fsm are built by the walks (sample, match,
+     *  alternatives, ...) so that the memory is proportional to the
+     *  visited states, constrain, setMask and print build the whole fsm.
+     *  The Antimirov backend is always lazy.
+     */
+    Fsm(const regexp::RegExp<T> &r, bool lazy, backend_t backend = backend_t::brzozowski)
       : rne_{}
+      , backend_{backend}
+      , hash_{r.hash()}
+      , rule_{r.to_string()}
     {
       std::random_device device;
       rne_.seed((static_cast<uint64_t>(device()) << 32) | device());
@@ -50,56 +225,281 @@ namespace fsm
           alphabet_map_.insert(std::make_pair(l, c));
           c++;
         }
+
+      if (lazy || backend == backend_t::antimirov)
+        {
+          // state 0 is the dead state
+          lazy_ = std::make_shared<lazy_table_t>();
+          lazy_->add(regexp::RegExp<T>::zero);
+          lazy_->add(r);
+          return;
+        }
+
       // regexp -> state index
       regexp_map_t states{std::make_pair(r, 1)};
+      if (r.nu() == regexp::RegExp<T>::one)
+        finals_.insert(1);
       build(r, 1, states);
 
-      std::map<std::pair<std::pair<states_idx_t, states_idx_t>, uint>, uint> epp_m;
-      for (const auto &t : trans_state_map_)
+      index();
+    };
+
+    //! Load the transitions compiled ahead of time for a regexp
+    /*! The regexp must print as the compiled one and the letters of the
+     *  tables are matched by name with its alphabet, the sampling maps
+     *  are then built as for a regexp compiled at run time.
+     */
+    Fsm(const regexp::RegExp<T> &r, const compiled_t &c)
+      : rne_{}
+      , backend_{c.backend}
+      , hash_{r.hash()}
+      , rule_{r.to_string()}
+    {
+      if (rule_ != c.rule) throw std::invalid_argument{"compiled tables do not match the regexp"};
+
+      std::random_device device;
+      rne_.seed((static_cast<uint64_t>(device()) << 32) | device());
+
+      std::unordered_map<std::string, T> names;
+      for (const auto &l : r.alphabet())
         {
-          states_idx_t q0_idx = t.first.first;
-          letter_idx_t l_idx  = t.first.second;
-          letter_t     l      = alphabet_[l_idx];
-          states_idx_t q1_idx = t.second;
-          unsigned int         epp    = Epp{}(l);
+          std::stringstream ss;
+          ss << l;
+          names.insert(std::make_pair(ss.str(), l));
+        }
+      if (names.size() != c.letters_n) throw std::invalid_argument{"compiled tables do not match the regexp alphabet"};
 
-          // insert state
-          if (state_states_map_.find(q0_idx) == state_states_map_.end())
-            state_states_map_.insert(std::make_pair(q0_idx, std::vector<states_idx_t>{q1_idx}));
-          else
-            state_states_map_.at(q0_idx).push_back(q1_idx);
+      for (letter_idx_t l_idx = 0; l_idx < c.letters_n; l_idx++)
+        {
+          const auto l_i = names.find(c.letters[l_idx]);
+          if (l_i == names.end()) throw std::invalid_argument{"compiled tables do not match the regexp alphabet"};
+          alphabet_.push_back(l_i->second);
+          alphabet_map_.insert(std::make_pair(l_i->second, l_idx));
+        }
 
-          // insert letter
-          auto trn_k = std::make_pair(q0_idx, q1_idx);
-          auto epp_k = std::make_pair(trn_k, epp);
-          if (trans_letters_map_.find(trn_k) == trans_letters_map_.end())
+      for (states_idx_t q = 1; q <= c.states; q++)
+        {
+          if (c.finals[q]) finals_.insert(q);
+          for (unsigned int s = c.first[q]; s < c.first[q + 1]; s++)
+            for (unsigned int k = c.parts[c.succ[s][1]]; k < c.parts[c.succ[s + 1][1]]; k++)
+              trans_state_map_.insert(std::make_pair(trans_t{q, c.lts[k]}, c.succ[s][0]));
+        }
+
+      index();
+    };
+
+    //! Construction backend
+    backend_t backend() const
+    {
+      return backend_;
+    };
+
+    //! Check whether the states are built on demand
+    bool lazy() const
+    {
+      return static_cast<bool>(lazy_);
+    };
+
+    //! Check whether a lazy fsm shares its states with another one
+    bool shares(const Fsm<T, Epp> &o) const
+    {
+      return lazy_ && lazy_ == o.lazy_;
+    };
+
+    //! Build the states of a lazy fsm up to some transitions from the start
+    void warmup(unsigned int depth) const
+    {
+      if (!lazy_) return;
+      std::vector<states_idx_t> level{1};
+      std::set<states_idx_t>    seen{1};
+      for (unsigned int d = 0; d < depth && !level.empty(); d++)
+        {
+          std::vector<states_idx_t> next;
+          for (auto q0 : level)
+            for (auto q1 : lazy_state(q0).states)
+              if (seen.insert(q1).second) next.push_back(q1);
+          level.swap(next);
+        }
+    };
+
+    //! Restrict the fsm to words whose consecutive letters are allowed
+    /*! The fsm is intersected with a small pairwise automaton whose
+     *  states are the classes of letters sharing the same set of
+     *  allowed successors, i.e. the product automaton has states
+     *
+     *    (q, c) with q a state of the fsm and c the class of the last letter
+     *
+     *  and a transition (q, c) -l-> (q', c(l)) for each transition
+     *  q -l-> q' of the fsm where l is allowed after the letters of class c.
+     *
+     *  The optional letter preceding the words restricts the first
+     *  letter of the words as well.
+     *
+     * @param allowed predicate over consecutive letters
+     * @param before  the letter preceding the words (if any)
+     */
+    void constrain(std::function<bool(const T &, const T &)> allowed, const std::optional<T> &before = std::nullopt)
+    {
+      using letters_t = std::vector<bool>;
+
+      materialize();
+
+      // allowed successors of each letter and of the preceding letter
+      unsigned int        n = alphabet_.size();
+      std::vector<letters_t> succ(n, letters_t(n, false));
+      for (letter_idx_t l0 = 0; l0 < n; l0++)
+        for (letter_idx_t l1 = 0; l1 < n; l1++)
+          succ[l0][l1] = allowed(alphabet_[l0], alphabet_[l1]);
+      letters_t succ0(n, true);
+      if (before)
+        for (letter_idx_t l1 = 0; l1 < n; l1++)
+          succ0[l1] = allowed(*before, alphabet_[l1]);
+
+      // group letters by allowed successors (class 0 is the initial one)
+      std::map<letters_t, uint>     class_m{std::make_pair(succ0, 0)};
+      std::vector<uint>             letter_class(n, 0);
+      std::vector<const letters_t *> class_succ{&class_m.begin()->first};
+      for (letter_idx_t l = 0; l < n; l++)
+        {
+          auto c = class_m.find(succ[l]);
+          if (c == class_m.end())
             {
-              std::vector<std::vector<letter_idx_t>> lts_v{{l_idx}};
-              trans_letters_map_.insert(std::make_pair(trn_k, lts_v));
-              epp_m.insert(std::make_pair(epp_k, 0));
+              c = class_m.insert(std::make_pair(succ[l], static_cast<uint>(class_succ.size()))).first;
+              class_succ.push_back(&c->first);
             }
-          else
+          letter_class[l] = c->second;
+        }
+
+      // transitions grouped by starting state
+      std::map<states_idx_t, std::vector<std::pair<letter_idx_t, states_idx_t>>> trans_m;
+      for (const auto &t : trans_state_map_)
+        trans_m[t.first.first].push_back(std::make_pair(t.first.second, t.second));
+
+      // explore the product automaton
+      using product_t = std::pair<states_idx_t, uint>;
+      std::map<product_t, states_idx_t> product_m{std::make_pair(product_t{1, 0}, 1)};
+      std::vector<product_t>            queue{product_t{1, 0}};
+      trans_state_map_t                 trans;
+      finals_t                          finals;
+      while (!queue.empty())
+        {
+          product_t    p0     = queue.back();
+          states_idx_t p0_idx = product_m.at(p0);
+          queue.pop_back();
+          if (finals_.find(p0.first) != finals_.end())
+            finals.insert(p0_idx);
+          const auto &t_i = trans_m.find(p0.first);
+          if (t_i == trans_m.end()) continue;
+          for (const auto &t : t_i->second)
             {
-              auto &lts_v = trans_letters_map_.at(trn_k);
-              if (epp_m.find(epp_k) == epp_m.end())
+              if (!(*class_succ[p0.second])[t.first]) continue;
+              product_t p1{t.second, letter_class[t.first]};
+              auto      p1_i = product_m.find(p1);
+              if (p1_i == product_m.end())
                 {
-                  lts_v.push_back(std::vector<letter_idx_t>{l_idx});
-                  epp_m.insert(std::make_pair(epp_k, lts_v.size() - 1));
+                  p1_i = product_m.insert(std::make_pair(p1, static_cast<states_idx_t>(product_m.size() + 1))).first;
+                  queue.push_back(p1);
                 }
-              else
-                lts_v[epp_m.at(epp_k)].push_back(l_idx);
+              trans.insert(std::make_pair(trans_t{p0_idx, t.first}, p1_i->second));
             }
         }
 
-      // sort letters
-      for (auto &t : trans_letters_map_)
-        for (auto &p : t.second)
-          std::sort(p.begin(), p.end(), [&](unsigned int a, unsigned int b) { return alphabet_[a] < alphabet_[b]; });
+      trans_state_map_ = trans;
+      finals_          = finals;
+      states_trace_.clear();
+      index();
+
+      if (finals_.find(1) == finals_.end() && state_states_map_.find(1) == state_states_map_.end())
+        throw std::invalid_argument{"no word satisfies the fsm constraint"};
     };
 
-    //! Print in Graphviz dot format
+    //! Restrict the letters allowed at each position of the words
+    /*! allowed[i][l] tells whether the l-th letter of the alphabet can be
+     *  at position i (positions past the mask are free), an empty mask
+     *  removes the restriction.
+     *
+     *  The mask is applied on top of the compiled transitions by the
+     *  sampling, the resampling and the alternatives, so that it can be
+     *  changed without rebuilding the fsm. A backward pass finds for each
+     *  position the states from which a word can still be completed and
+     *  the sampling only walks through them, it never gets stuck.
+     */
+    void setMask(const std::vector<std::vector<bool>> &allowed)
+    {
+      for (const auto &a : allowed)
+        if (a.size() != alphabet_.size()) throw std::invalid_argument{"mask size must match the alphabet size"};
+
+      materialize();
+      mask_ = allowed;
+      states_trace_.clear();
+      index_mask();
+
+      if (!live(0, 1))
+        throw std::invalid_argument{"no word satisfies the fsm mask"};
+    };
+
+    //! Set the sampling weights of the letters
+    /*! The successors of a state are drawn in proportion to the weights
+     *  of their letters and then the letter of the transition in
+     *  proportion to its weight, i.e. each letter leaving a state with
+     *  probability w(l) / Σ w. The default source (an empty function)
+     *  draws the successors in proportion to their number of letters
+     *  and the Epp partitions of a transition equi-probably. The alias
+     *  tables are rebuilt only here and when the transitions change.
+     *
+     *  A lazy fsm stays lazy: it first takes its own copy of the states
+     *  built so far when they are shared with other copies (which keep
+     *  their weights), the built states are weighed again and the new
+     *  ones are weighed when built.
+     */
+    void setWeights(weight_t<T> weight)
+    {
+      if (weight)
+        for (const auto &l : alphabet_)
+          {
+            const double w = weight(l);
+            if (!(w > 0.0) || w == std::numeric_limits<double>::infinity())
+              throw std::invalid_argument{"letter weights must be positive"};
+          }
+
+      if (lazy_)
+        {
+          if (lazy_.use_count() > 1) lazy_ = lazy_->clone();
+          std::lock_guard<std::mutex> lock{lazy_->mutex};
+          lazy_->weight = weight;
+          for (states_idx_t q = 1; q < lazy_->size; q++)
+            if ((*lazy_)[q].ready.load(std::memory_order_relaxed)) lazy_weigh((*lazy_)[q]);
+          return;
+        }
+      weight_ = weight;
+      index_weights();
+    };
+
+    //! Take the sampling weights of a copy
+    /*! A lazy fsm then shares the weighed states of the copy, so that
+     *  the copies of a lazy fsm are weighed once (see setWeights).
+     */
+    void shareWeights(const Fsm<T, Epp> &o)
+    {
+      if (lazy_ && o.lazy_)
+        {
+          lazy_ = o.lazy_;
+          return;
+        }
+      setWeights(o.lazy_ ? o.lazy_->weight : o.weight_);
+    };
+
+    //! Print in Graphviz dot format (the built states of a lazy fsm)
     void print(std::ostream &os) const
     {
+      if (lazy_)
+        {
+          Fsm<T, Epp> m{*this};
+          m.materialize(false);
+          m.print(os);
+          return;
+        }
+
       os << "digraph FSM {\n"
          << "  rankdir = LR;\n"
          << "  node [shape = plain];\n"
@@ -111,22 +511,23 @@ namespace fsm
          << "  start -> 1;\n";
       for (const auto &t : trans_letters_map_)
         {
-          if (t.second.size() == 1)
-            for (auto l_idx : t.second[0])
+          const auto epp_v = partitions(t.second.letters);
+          if (epp_v.size() == 1)
+            for (auto l_idx : epp_v[0])
               os << "  "
                  << t.first.first
                  << " -> "
                  << t.first.second
                  << " [label=\"" << alphabet_[l_idx] << "\"];\n";
-          else if (t.second.size() > 1)
+          else if (epp_v.size() > 1)
             {
-              for (size_t epp_idx = 0; epp_idx < t.second.size(); epp_idx++)
+              for (size_t epp_idx = 0; epp_idx < epp_v.size(); epp_idx++)
                 os << "# epp " << epp_idx << "\n"
                    << "  "
                    << t.first.first
                    << " -> "
                    << t.first.second
-                   << " [label=\"" << alphabet_[t.second[epp_idx][0]] << "... (" << t.second[epp_idx].size() << ")\"];\n";
+                   << " [label=\"" << alphabet_[epp_v[epp_idx][0]] << "... (" << epp_v[epp_idx].size() << ")\"];\n";
             }
         }
       os << "}\n";
@@ -139,9 +540,134 @@ namespace fsm
       return ss.str();
     };
 
+    //! Print the transitions as the constexpr tables of a C++ header
+    /*! The struct named after the rule holds the tables of compiled_t,
+     *  they are registered for the regexp (by hash, backend and printed
+     *  regexp) so that a build including the header loads the fsm from
+     *  them, and StaticFsm samples over them directly. The states are
+     *  renumbered over the ones kept by the sampling maps.
+     */
+    void print_compiled(std::ostream &os, const std::string &name) const
+    {
+      if (lazy_)
+        {
+          Fsm<T, Epp> m{*this};
+          m.materialize();
+          m.print_compiled(os, name);
+          return;
+        }
+
+      // kept states (1 is always the first one)
+      std::map<states_idx_t, unsigned int> state_m{std::make_pair(1, 0)};
+      for (const auto &t : trans_letters_map_)
+        {
+          state_m.insert(std::make_pair(t.first.first, 0));
+          state_m.insert(std::make_pair(t.first.second, 0));
+        }
+      unsigned int n = 0;
+      for (auto &q : state_m)
+        q.second = ++n;
+
+      // successors of each state (in order) with the partitions of
+      // their letters
+      using parts_t = std::vector<std::vector<letter_idx_t>>;
+      std::vector<std::vector<std::pair<unsigned int, parts_t>>> succ(n + 1);
+      size_t                                                     trans_n = 0;
+      for (const auto &t : trans_letters_map_)
+        {
+          succ[state_m.at(t.first.first)].push_back(std::make_pair(state_m.at(t.first.second), partitions(t.second.letters)));
+          trans_n += t.second.letters.size();
+        }
+
+      auto quote = [](const auto &l) {
+        std::stringstream ss;
+        ss << l;
+        std::string q{"\""};
+        for (char ch : ss.str())
+          {
+            if (ch == '"' || ch == '\\') q += '\\';
+            q += ch;
+          }
+        return q + "\"";
+      };
+
+      os << "// rule " << name << ": " << n << " states, " << trans_n << " transitions\n"
+         << "struct " << name << "\n"
+         << "{\n"
+         << "  static constexpr size_t         hash       = " << hash_ << "ULL;\n"
+         << "  static constexpr fsm::backend_t backend    = fsm::backend_t::" << (backend_ == backend_t::antimirov ? "antimirov" : "brzozowski") << ";\n"
+         << "  static constexpr const char *   rule       = " << quote(rule_) << ";\n"
+         << "  static constexpr unsigned int   states     = " << n << ";\n"
+         << "  static constexpr unsigned int   letters_n  = " << alphabet_.size() << ";\n";
+
+      os << "  static constexpr const char *   letters[]  = {";
+      for (letter_idx_t l_idx = 0; l_idx < alphabet_.size(); l_idx++)
+        os << (l_idx == 0 ? "" : ", ") << quote(alphabet_[l_idx]);
+      os << (alphabet_.empty() ? "nullptr" : "") << "};\n";
+
+      os << "  static constexpr bool           finals[]   = {false";
+      for (const auto &q : state_m)
+        os << ", " << (finals_.find(q.first) != finals_.end() ? "true" : "false");
+      os << "};\n";
+
+      size_t f = 0;
+      os << "  static constexpr unsigned int   first[]    = {0";
+      for (unsigned int q = 1; q <= n; q++)
+        {
+          os << ", " << f;
+          f += succ[q].size();
+        }
+      os << ", " << f << "};\n";
+
+      size_t p = 0;
+      os << "  static constexpr unsigned int   succ[][2]  = {";
+      for (unsigned int q = 1; q <= n; q++)
+        for (const auto &s : succ[q])
+          {
+            os << "{" << s.first << ", " << p << "}, ";
+            p += s.second.size();
+          }
+      os << "{0, " << p << "}};\n";
+
+      size_t k = 0;
+      os << "  static constexpr unsigned int   parts[]    = {";
+      for (unsigned int q = 1; q <= n; q++)
+        for (const auto &s : succ[q])
+          for (const auto &lts_v : s.second)
+            {
+              os << k << ", ";
+              k += lts_v.size();
+            }
+      os << k << "};\n";
+
+      os << "  static constexpr unsigned int   lts[]      = {";
+      k = 0;
+      for (unsigned int q = 1; q <= n; q++)
+        for (const auto &s : succ[q])
+          for (const auto &lts_v : s.second)
+            for (auto lt : lts_v)
+              os << (k++ == 0 ? "" : ", ") << lt;
+      os << (trans_n == 0 ? "0" : "") << "};\n"
+         << "};\n\n"
+         << "inline const fsm::compiled_t " << name << "_compiled{" << name << "::hash, " << name << "::backend, \"" << name << "\", " << name << "::rule, "
+         << name << "::states, " << name << "::letters_n, " << name << "::letters, " << name << "::finals, " << name << "::first, " << name << "::succ, "
+         << name << "::parts, " << name << "::lts};\n"
+         << "inline const bool            " << name << "_registered = fsm::register_compiled(" << name << "_compiled);\n"
+         << "using " << name << "_fsm = fsm::StaticFsm<" << name << ">;\n";
+    };
+
+    //! Seed the sampling random engine (copies share the engine state)
+    void seed(uint64_t s)
+    {
+      rne_.seed(s);
+    };
+
     //! Walk a random path through the fsm and generate a word
     const std::vector<T> sample() const
     {
+      if (!mask_.empty()) return sample_masked();
+      if (lazy_) return sample_lazy();
+
       using dist_t = std::uniform_int_distribution<size_t>;
       std::vector<T> res;
       states_idx_t   q0 = 1;
@@ -153,25 +679,24 @@ namespace fsm
           if (stop && dist_t{0, 1}(rne_) == 0) break;
 
           const auto &q1_i = state_states_map_.find(q0);
-          if (q1_i == state_states_map_.end() || q1_i->second.empty())
+          if (q1_i == state_states_map_.end() || q1_i->second.states.empty())
             {
               if (stop) break;
               // dangling states should have been pruned
               throw std::runtime_error{"dangling state in fsm"};
             }
           const auto & q1_v  = q1_i->second;
-          states_idx_t q1    = q1_v.size() > 1 ? q1_v[dist_t{0, q1_v.size() - 1}(rne_)] : q1_v[0];
+          states_idx_t q1    = q1_v.states[q1_v.alias.draw(rne_)];
           auto         trn_k = std::make_pair(q0, q1);
-          const auto & epp_i = trans_letters_map_.find(trn_k);
-          if (epp_i == trans_letters_map_.end() || epp_i->second.empty())
+          const auto & lts_i = trans_letters_map_.find(trn_k);
+          if (lts_i == trans_letters_map_.end() || lts_i->second.letters.empty())
             {
               if (stop) break;
               // dangling states should have been pruned
               throw std::runtime_error{"dangling state in fsm"};
             }
-          const auto &epp_v = epp_i->second;
-          const auto &lts_v = epp_v.size() > 1 ? epp_v[dist_t{0, epp_v.size() - 1}(rne_)] : epp_v[0];
-          auto        lt    = lts_v.size() > 1 ? lts_v[dist_t{0, lts_v.size() - 1}(rne_)] : lts_v[0];
+          const auto &lts_v = lts_i->second;
+          auto        lt    = lts_v.letters[lts_v.alias.draw(rne_)];
           res.push_back(alphabet_[lt]);
           q0 = q1;
           states_trace_.push_back(q1);
@@ -183,18 +708,21 @@ namespace fsm
     const std::vector<T> resample() const
     {
       if (states_trace_.size() < 2) return sample();
-      using dist_t = std::uniform_int_distribution<size_t>;
       std::vector<T> res;
       for (auto q0_i = states_trace_.begin(); q0_i != states_trace_.end() - 1; ++q0_i)
         {
-          auto        trn_k = std::make_pair(*q0_i, *(q0_i + 1));
-          const auto &epp_i = trans_letters_map_.find(trn_k);
-          if (epp_i == trans_letters_map_.end() || epp_i->second.empty())
+          const auto *lts_p = transition_letters(*q0_i, *(q0_i + 1));
+          if (lts_p == nullptr || lts_p->letters.empty())
             throw std::runtime_error{"dangling state in fsm resampling"};
-          const auto &epp_v = epp_i->second;
-          const auto &lts_v = epp_v.size() > 1 ? epp_v[dist_t{0, epp_v.size() - 1}(rne_)] : epp_v[0];
-          auto        lt    = lts_v.size() > 1 ? lts_v[dist_t{0, lts_v.size() - 1}(rne_)] : lts_v[0];
-          res.push_back(alphabet_[lt]);
+          if (!mask_.empty())
+            {
+              // the path may not fit a mask set after the sample
+              auto lt = draw_masked(res.size(), *lts_p);
+              if (!lt) return sample();
+              res.push_back(alphabet_[*lt]);
+              continue;
+            }
+          res.push_back(alphabet_[lts_p->letters[lts_p->alias.draw(rne_)]]);
         }
       return res;
     };
@@ -208,23 +736,22 @@ namespace fsm
       unsigned int   i = 0;
       for (auto q0_i = states_trace_.begin(); q0_i != states_trace_.end() - 1; ++q0_i)
         {
-          auto        trn_k = std::make_pair(*q0_i, *(q0_i + 1));
-          const auto &epp_i = trans_letters_map_.find(trn_k);
-          if (epp_i == trans_letters_map_.end() || epp_i->second.empty())
+          const auto *lts_p = transition_letters(*q0_i, *(q0_i + 1));
+          if (lts_p == nullptr || lts_p->letters.empty())
             throw std::runtime_error{"dangling state in fsm resampling"};
-          const auto &epp_v   = epp_i->second;
-          double      fit_min = 0.0;
-          int         fit_idx = -1;
-          for (const auto &lts_v : epp_v)
-            for (const auto &lt : lts_v)
-              {
-                double f = fitness(i, res, alphabet_[lt]);
-                if (f < fit_min || fit_idx == -1)
-                  {
-                    fit_min = f;
-                    fit_idx = static_cast<int>(lt);
-                  }
-              }
+          double fit_min = 0.0;
+          int    fit_idx = -1;
+          for (const auto &lt : lts_p->letters)
+            {
+              if (!allowed(i, lt)) continue;
+              double f = fitness(i, res, alphabet_[lt]);
+              if (f < fit_min || fit_idx == -1)
+                {
+                  fit_min = f;
+                  fit_idx = static_cast<int>(lt);
+                }
+            }
+          if (fit_idx == -1 && !mask_.empty()) return sample();
           if (fit_idx == -1) throw std::runtime_error{"could not determine fittest letter in resampling"};
           res.push_back(alphabet_[fit_idx]);
           i++;
@@ -232,6 +759,94 @@ namespace fsm
       return res;
     };
 
+    //! Letters that can replace the i-th letter of a word
+    /*! The rest of the word is kept fixed, the result holds all the
+     *  letters (the word letter included) that keep the word accepted
+     *  and allowed by the mask, it is empty if the word is not accepted.
+     */
+    std::vector<T> alternatives(const std::vector<T> &w, size_t i) const
+    {
+      std::vector<T> res;
+      for (size_t lt : alternative_letters(w, i))
+        res.push_back(alphabet_[lt]);
+      return res;
+    };
+
+    //! Alphabet indices of the letters that can replace the i-th letter of a word
+    std::vector<size_t> alternative_letters(const std::vector<T> &w, size_t i) const
+    {
+      std::vector<size_t> res;
+      if (i >= w.size()) return res;
+
+      // run through the word from a state, 0 if it gets stuck
+      auto run = [&](states_idx_t s, size_t j0, size_t j1) -> states_idx_t {
+        for (size_t j = j0; j < j1 && s != 0; j++)
+          {
+            const auto l_i = alphabet_map_.find(w[j]);
+            if (l_i == alphabet_map_.end()) return 0;
+            s = step(s, l_i->second);
+          }
+        return s;
+      };
+
+      states_idx_t q0   = run(1, 0, i);
+      const auto * q1_p = q0 == 0 ? nullptr : successors(q0);
+      if (q1_p == nullptr) return res;
+
+      for (states_idx_t q1 : *q1_p)
+        {
+          states_idx_t q = run(q1, i + 1, w.size());
+          if (q == 0 || !final(q)) continue;
+          for (const auto &lt : transition_letters(q0, q1)->letters)
+            if (allowed(i, lt)) res.push_back(lt);
+        }
+      return res;
+    };
+
+    //! Number of states (built so far when lazy)
+    size_t states() const
+    {
+      if (lazy_)
+        {
+          std::lock_guard<std::mutex> lock{lazy_->mutex};
+          return lazy_->size - 1;
+        }
+      std::set<states_idx_t> states{finals_};
+      states.insert(1);
+      for (const auto &t : trans_state_map_)
+        {
+          states.insert(t.first.first);
+          states.insert(t.second);
+        }
+      return states.size();
+    };
+
+    //! Number of transitions (one per letter, built so far when lazy)
+    size_t transitions() const
+    {
+      if (lazy_)
+        {
+          std::lock_guard<std::mutex> lock{lazy_->mutex};
+          size_t                      n = 0;
+          for (states_idx_t q = 0; q < lazy_->size; q++)
+            n += (*lazy_)[q].trans.size();
+          return n;
+        }
+      return trans_state_map_.size();
+    };
+
+    //! Letter of the alphabet
+    const T &letter(size_t idx) const
+    {
+      return alphabet_[idx];
+    };
+
+    //! Number of letters of the alphabet
+    size_t letters() const
+    {
+      return alphabet_.size();
+    };
+
     //! Match a word against the fsm
     bool match(const std::vector<T> &w) const
     {
@@ -241,17 +856,25 @@ namespace fsm
           const auto l_i = alphabet_map_.find(l);
           if (l_i == alphabet_map_.end())
             return false;
-          const auto t_i = trans_state_map_.find(std::make_pair(s, l_i->second));
-          if (t_i == trans_state_map_.end())
+          s = step(s, l_i->second);
+          if (s == 0)
             return false;
-          s = t_i->second;
         }
-      return finals_.find(s) != finals_.end();
+      return final(s);
     };
 
   private:
     mutable std::mt19937_64 rne_;
 
+    backend_t backend_ = backend_t::brzozowski;
+
+    // hash and printed regexp (the keys of the tables compiled ahead of time)
+    size_t      hash_ = 0;
+    std::string rule_;
+
+    // sampling weight of the letters (Epp partitions when empty)
+    weight_t<T> weight_;
+
     using letter_t     = T;
     using letter_idx_t = uint;
     using regexp_t     = regexp::RegExp<letter_t>;
@@ -268,16 +891,31 @@ namespace fsm
     // (q0_idx, letter_idx) => q1_idx
     using trans_state_map_t = std::map<trans_t, states_idx_t>;
 
+    // successors of a state (once for each letter) drawn in proportion
+    // to the mean weight of the transition letters
+    struct successors_t
+    {
+      std::vector<states_idx_t> states;
+      alias_t                   alias;
+    };
+
+    // letters of a transition (grouped by Epp partition) drawn in
+    // proportion to their weights
+    struct letters_t
+    {
+      std::vector<letter_idx_t> letters;
+      std::vector<double>       weights;
+      double                    total = 0.0;
+      alias_t                   alias;
+    };
+
     // states map used in sampling
     // q0_idx => {q1_idx,q1_idx',q1_idx'',...}
-    using state_states_map_t = std::map<states_idx_t, std::vector<states_idx_t>>;
+    using state_states_map_t = std::map<states_idx_t, successors_t>;
 
     // letters associated to each transition
-    // (q0_idx, q1_idx) => {{l,l',l'',...}
-    //                      {m,m',m'',...}
-    //                      ...}
-    // partitioned over equi-probable letter sets
-    using trans_letters_map_t = std::map<std::pair<states_idx_t, states_idx_t>, std::vector<std::vector<letter_idx_t>>>;
+    // (q0_idx, q1_idx) => {l,l',l'',...}
+    using trans_letters_map_t = std::map<std::pair<states_idx_t, states_idx_t>, letters_t>;
 
     // alphabet
     std::vector<letter_t> alphabet_;
@@ -296,10 +934,564 @@ namespace fsm
     // state trace
     mutable std::vector<states_idx_t> states_trace_;
 
+    // state of a lazy fsm: the derivatives are built when a walk or a
+    // liveness search first leaves it, the sampling tables (over the
+    // successors from which a final state can be reached) when a walk
+    // first leaves it, only their weights change afterwards
+    struct lazy_state_t
+    {
+      std::atomic<bool>                                   ready{false};
+      bool                                                expanded = false;
+      bool                                                final    = false;
+      int                                                 live     = 0;
+      std::vector<std::pair<letter_idx_t, states_idx_t>> trans;
+      std::vector<states_idx_t>                           succ;
+      alias_t                                             alias;
+      std::vector<states_idx_t>                           states;
+      std::vector<letters_t>                              letters;
+    };
+
+    // chunks of the lazy states table, the chunk k holds 64 * 2^k states
+    static constexpr unsigned int LAZY_CHUNKS = 26;
+
+    // states of a lazy fsm shared by its copies, the states are kept in
+    // chunks that never move so that the ready states are read without
+    // locking while new ones are added, the mutex guards the rest
+    struct lazy_table_t
+    {
+      std::mutex                                         mutex;
+      regexp_map_t                                       regexp_map;
+      std::vector<regexp_t>                              regexps;
+      states_idx_t                                       size = 0;
+      std::array<std::atomic<lazy_state_t *>, LAZY_CHUNKS> chunks{};
+      std::vector<std::unique_ptr<lazy_state_t[]>>       owned;
+      weight_t<T>                                        weight;
+
+      lazy_state_t &operator[](states_idx_t q) const
+      {
+        size_t       v = (static_cast<size_t>(q) >> 6) + 1;
+        unsigned int k = 0;
+        while (v >>= 1) k++;
+        return chunks[k].load(std::memory_order_acquire)[q - (((size_t{1} << k) - 1) << 6)];
+      };
+
+      // add a state for a regexp (with the mutex held)
+      states_idx_t add(const regexp_t &r)
+      {
+        const states_idx_t q = size;
+        if (q == (((size_t{1} << owned.size()) - 1) << 6))
+          {
+            if (owned.size() == LAZY_CHUNKS) throw std::runtime_error{"too many states in lazy fsm"};
+            owned.emplace_back(new lazy_state_t[size_t{64} << owned.size()]);
+            chunks[owned.size() - 1].store(owned.back().get(), std::memory_order_release);
+          }
+        size++;
+        regexp_map.insert(std::make_pair(r, q));
+        regexps.push_back(r);
+        (*this)[q].final = r.nu() == regexp::RegExp<T>::one;
+        return q;
+      };
+
+      // copy of the table with its built states
+      std::shared_ptr<lazy_table_t> clone()
+      {
+        std::lock_guard<std::mutex> lock{mutex};
+        auto                        t = std::make_shared<lazy_table_t>();
+        t->weight                     = weight;
+        for (states_idx_t q = 0; q < size; q++)
+          {
+            const lazy_state_t &s  = (*this)[q];
+            lazy_state_t &      s1 = (*t)[t->add(regexps[q])];
+            s1.expanded            = s.expanded;
+            s1.live                = s.live;
+            s1.trans               = s.trans;
+            s1.succ                = s.succ;
+            s1.alias               = s.alias;
+            s1.states              = s.states;
+            s1.letters             = s.letters;
+            s1.ready.store(s.ready.load(std::memory_order_relaxed), std::memory_order_relaxed);
+          }
+        return t;
+      };
+    };
+
+    std::shared_ptr<lazy_table_t> lazy_;
+
+    // ready state of a lazy fsm
+    const lazy_state_t &lazy_state(states_idx_t q) const
+    {
+      lazy_state_t &s = (*lazy_)[q];
+      if (s.ready.load(std::memory_order_acquire)) return s;
+
+      std::lock_guard<std::mutex> lock{lazy_->mutex};
+      if (s.ready.load(std::memory_order_relaxed)) return s;
+
+      // the letters of each live successor are partitioned as in index
+      lazy_expand(q);
+      std::map<std::pair<states_idx_t, uint>, size_t>    epp_m;
+      std::vector<std::vector<std::vector<letter_idx_t>>> epp_v;
+      for (const auto &t : s.trans)
+        {
+          const letter_idx_t l_idx  = t.first;
+          const states_idx_t q1_idx = t.second;
+          if (!lazy_live(q1_idx)) continue;
+          s.succ.push_back(q1_idx);
+
+          auto q1_s = std::find(s.states.begin(), s.states.end(), q1_idx);
+          if (q1_s == s.states.end())
+            {
+              s.states.push_back(q1_idx);
+              epp_v.emplace_back();
+              q1_s = s.states.end() - 1;
+            }
+          auto &lts_v = epp_v[q1_s - s.states.begin()];
+          auto  epp_k = std::make_pair(q1_idx, Epp{}(alphabet_[l_idx]));
+          auto  epp_i = epp_m.find(epp_k);
+          if (epp_i == epp_m.end())
+            {
+              epp_m.insert(std::make_pair(epp_k, lts_v.size()));
+              lts_v.push_back(std::vector<letter_idx_t>{l_idx});
+            }
+          else
+            lts_v[epp_i->second].push_back(l_idx);
+        }
+      for (auto &lts_v : epp_v)
+        s.letters.push_back(letters(lts_v));
+      lazy_weigh(s);
+
+      s.ready.store(true, std::memory_order_release);
+      return s;
+    };
+
+    // alias tables of the letters and of the successors of a lazy state
+    // (with the mutex held)
+    void lazy_weigh(lazy_state_t &s) const
+    {
+      for (auto &lts_v : s.letters)
+        weigh(lts_v);
+      std::vector<double> w;
+      for (auto q1 : s.succ)
+        {
+          const auto &lts_v = s.letters[std::find(s.states.begin(), s.states.end(), q1) - s.states.begin()];
+          w.push_back(lts_v.total / static_cast<double>(lts_v.letters.size()));
+        }
+      s.alias = alias_t{w};
+    };
+
+    // derive the regexp of a lazy state with respect to each letter
+    // (with the mutex held)
+    void lazy_expand(states_idx_t q) const
+    {
+      lazy_state_t &s = (*lazy_)[q];
+      if (s.expanded) return;
+
+      const regexp_t r = lazy_->regexps[q];
+      for (letter_idx_t l_idx = 0; l_idx < alphabet_.size(); l_idx++)
+        {
+          const regexp_t q1 = derive(r, alphabet_[l_idx]);
+          if (q1 == regexp::RegExp<T>::zero) continue;
+          auto q1_i = lazy_->regexp_map.find(q1);
+          s.trans.push_back(std::make_pair(l_idx, q1_i == lazy_->regexp_map.end() ? lazy_->add(q1) : q1_i->second));
+        }
+      s.expanded = true;
+    };
+
+    // check whether a final state can be reached from a lazy state (with
+    // the mutex held), a breadth first search marks the states on the
+    // path to the closest final state as live or all the visited states
+    // as dead
+    bool lazy_live(states_idx_t q) const
+    {
+      if ((*lazy_)[q].live != 0) return (*lazy_)[q].live > 0;
+
+      std::vector<states_idx_t>                      visit{q};
+      std::unordered_map<states_idx_t, states_idx_t> parent{std::make_pair(q, 0)};
+      for (size_t i = 0; i < visit.size(); i++)
+        {
+          const states_idx_t q0 = visit[i];
+          lazy_state_t &     s0 = (*lazy_)[q0];
+          if (s0.live < 0) continue;
+          if (s0.final || s0.live > 0)
+            {
+              for (states_idx_t p = q0; p != 0; p = parent[p])
+                (*lazy_)[p].live = 1;
+              return true;
+            }
+          lazy_expand(q0);
+          for (const auto &t : s0.trans)
+            if (parent.insert(std::make_pair(t.second, q0)).second) visit.push_back(t.second);
+        }
+      for (auto q0 : visit)
+        (*lazy_)[q0].live = -1;
+      return false;
+    };
+
+    // build the whole lazy fsm (or keep the built states) and switch to
+    // the eager maps
+    void materialize(bool all = true)
+    {
+      if (!lazy_) return;
+      if (all) warmup(std::numeric_limits<unsigned int>::max());
+
+      std::lock_guard<std::mutex> lock{lazy_->mutex};
+      trans_state_map_.clear();
+      finals_.clear();
+      for (states_idx_t q = 1; q < lazy_->size; q++)
+        {
+          const auto &s = (*lazy_)[q];
+          if (s.final) finals_.insert(q);
+          for (const auto &t : s.trans)
+            trans_state_map_.insert(std::make_pair(trans_t{q, t.first}, t.second));
+        }
+      weight_ = lazy_->weight;
+      lazy_.reset();
+      index();
+    };
+
+    // next state, 0 if the letter is not accepted
+    states_idx_t step(states_idx_t q, letter_idx_t lt) const
+    {
+      if (lazy_)
+        {
+          for (const auto &t : lazy_state(q).trans)
+            if (t.first == lt) return t.second;
+          return 0;
+        }
+      const auto t_i = trans_state_map_.find(std::make_pair(q, lt));
+      return (t_i == trans_state_map_.end()) ? 0 : t_i->second;
+    };
+
+    // check whether a state is final
+    bool final(states_idx_t q) const
+    {
+      if (lazy_) return (*lazy_)[q].final;
+      return finals_.find(q) != finals_.end();
+    };
+
+    // successors of a state, null if there are none
+    const std::vector<states_idx_t> *successors(states_idx_t q) const
+    {
+      if (lazy_)
+        {
+          const auto &s = lazy_state(q);
+          return s.succ.empty() ? nullptr : &s.succ;
+        }
+      const auto q1_i = state_states_map_.find(q);
+      return q1_i == state_states_map_.end() ? nullptr : &q1_i->second.states;
+    };
+
+    // letters of a transition, null if there is none
+    const letters_t *transition_letters(states_idx_t q0, states_idx_t q1) const
+    {
+      if (lazy_)
+        {
+          const auto &s    = lazy_state(q0);
+          const auto  q1_s = std::find(s.states.begin(), s.states.end(), q1);
+          return q1_s == s.states.end() ? nullptr : &s.letters[q1_s - s.states.begin()];
+        }
+      const auto lts_i = trans_letters_map_.find(std::make_pair(q0, q1));
+      return lts_i == trans_letters_map_.end() ? nullptr : &lts_i->second;
+    };
+
+    // walk a random path through a lazy fsm as in sample, the walk only
+    // steps into states from which a final state can be reached
+    const std::vector<T> sample_lazy() const
+    {
+      using dist_t = std::uniform_int_distribution<size_t>;
+      std::vector<T> res;
+      states_idx_t   q0 = 1;
+      states_trace_.clear();
+      states_trace_.push_back(q0);
+      while (true)
+        {
+          const auto &s    = lazy_state(q0);
+          bool        stop = s.final;
+          if (stop && (s.succ.empty() || dist_t{0, 1}(rne_) == 0)) break;
+          // only the start state may be dead
+          if (s.succ.empty()) throw std::runtime_error{"dangling state in fsm"};
+
+          states_idx_t q1    = s.succ[s.alias.draw(rne_)];
+          const auto & lts_v = *transition_letters(q0, q1);
+          auto         lt    = lts_v.letters[lts_v.alias.draw(rne_)];
+          res.push_back(alphabet_[lt]);
+          q0 = q1;
+          states_trace_.push_back(q0);
+        }
+      return res;
+    };
+
+    // letters allowed at each position of the words
+    // i => {allowed(l), allowed(l'), ...}
+    std::vector<std::vector<bool>> mask_;
+
+    // states from which a word can be completed at each position
+    // i => {live(q), live(q'), ...} (mask size + 1 positions)
+    std::vector<std::vector<bool>> live_;
+
+    // check whether a letter is allowed at a position
+    bool allowed(size_t i, letter_idx_t lt) const
+    {
+      return i >= mask_.size() || mask_[i][lt];
+    };
+
+    // check whether a word can be completed from a state at a position
+    bool live(size_t i, states_idx_t q) const
+    {
+      return i >= mask_.size() || (q < live_[i].size() && live_[i][q]);
+    };
+
+    // weight of the allowed letters of a transition
+    double masked_weight(size_t i, const letters_t &lts_v) const
+    {
+      double w = 0.0;
+      for (size_t k = 0; k < lts_v.letters.size(); k++)
+        if (allowed(i, lts_v.letters[k])) w += lts_v.weights[k];
+      return w;
+    };
+
+    // draw an allowed letter of a transition in proportion to its
+    // weight (linear, the alias table covers all the letters), none if
+    // no letter is allowed
+    std::optional<letter_idx_t> draw_masked(size_t i, const letters_t &lts_v) const
+    {
+      const double total = masked_weight(i, lts_v);
+      if (!(total > 0.0)) return std::nullopt;
+      double                      u = std::uniform_real_distribution<double>{0.0, total}(rne_);
+      std::optional<letter_idx_t> res;
+      for (size_t k = 0; k < lts_v.letters.size(); k++)
+        {
+          if (!allowed(i, lts_v.letters[k])) continue;
+          res = lts_v.letters[k];
+          if (u < lts_v.weights[k]) break;
+          u -= lts_v.weights[k];
+        }
+      return res;
+    };
+
+    // backward pass over the masked transitions, past the mask every
+    // state left by the pruning is live
+    void index_mask()
+    {
+      live_.clear();
+      if (mask_.empty()) return;
+
+      states_idx_t n = 2;
+      for (const auto &t : trans_letters_map_)
+        n = std::max(n, std::max(t.first.first, t.first.second) + 1);
+      for (auto q : finals_)
+        n = std::max(n, q + 1);
+
+      live_.assign(mask_.size() + 1, std::vector<bool>(n, true));
+      for (size_t i = mask_.size(); i-- > 0;)
+        {
+          for (states_idx_t q = 0; q < n; q++)
+            live_[i][q] = finals_.find(q) != finals_.end();
+          for (const auto &t : trans_letters_map_)
+            {
+              if (live_[i][t.first.first] || !live_[i + 1][t.first.second]) continue;
+              const auto &lts_v = t.second.letters;
+              if (std::any_of(lts_v.begin(), lts_v.end(), [&](letter_idx_t lt) { return mask_[i][lt]; }))
+                live_[i][t.first.first] = true;
+            }
+        }
+    };
+
+    // walk a random path through the live states with the allowed
+    // letters, the choices are those of sample weighted over what is
+    // left
+    const std::vector<T> sample_masked() const
+    {
+      using dist_t = std::uniform_int_distribution<size_t>;
+      std::vector<T> res;
+      states_idx_t   q0 = 1;
+      states_trace_.clear();
+      states_trace_.push_back(q0);
+      while (true)
+        {
+          const size_t i    = res.size();
+          bool         stop = finals_.find(q0) != finals_.end();
+
+          // live successors reached with some allowed letter
+          std::vector<states_idx_t> q1_v;
+          std::vector<double>       w_v;
+          const auto &              q1_i = state_states_map_.find(q0);
+          if (q1_i != state_states_map_.end())
+            for (states_idx_t q1 : q1_i->second.states)
+              {
+                if (!live(i + 1, q1)) continue;
+                const auto & lts_v = trans_letters_map_.at(std::make_pair(q0, q1));
+                const double w     = masked_weight(i, lts_v);
+                if (w > 0.0)
+                  {
+                    q1_v.push_back(q1);
+                    w_v.push_back(w / static_cast<double>(lts_v.letters.size()));
+                  }
+              }
+
+          if (q1_v.empty())
+            {
+              if (stop) break;
+              // dead states are not live
+              throw std::runtime_error{"dead end in masked fsm"};
+            }
+          if (stop && dist_t{0, 1}(rne_) == 0) break;
+
+          states_idx_t q1 = q1_v.size() > 1 ? q1_v[std::discrete_distribution<size_t>{w_v.begin(), w_v.end()}(rne_)] : q1_v[0];
+          auto         lt = *draw_masked(i, trans_letters_map_.at(std::make_pair(q0, q1)));
+          res.push_back(alphabet_[lt]);
+          q0 = q1;
+          states_trace_.push_back(q1);
+        }
+      return res;
+    };
+
+    // build the sampling maps from the transitions pruning the states
+    // from which no final state can be reached
+    void index()
+    {
+      state_states_map_.clear();
+      trans_letters_map_.clear();
+
+      // productive states
+      std::map<states_idx_t, std::vector<states_idx_t>> rev_m;
+      for (const auto &t : trans_state_map_)
+        rev_m[t.second].push_back(t.first.first);
+      std::set<states_idx_t>    productive{finals_};
+      std::vector<states_idx_t> queue{finals_.begin(), finals_.end()};
+      while (!queue.empty())
+        {
+          states_idx_t q1 = queue.back();
+          queue.pop_back();
+          const auto &q0_i = rev_m.find(q1);
+          if (q0_i == rev_m.end()) continue;
+          for (auto q0 : q0_i->second)
+            if (productive.insert(q0).second)
+              queue.push_back(q0);
+        }
+
+      std::map<std::pair<states_idx_t, states_idx_t>, std::vector<std::vector<letter_idx_t>>> trans_epp_m;
+      std::map<std::pair<std::pair<states_idx_t, states_idx_t>, uint>, uint>                   epp_m;
+      for (const auto &t : trans_state_map_)
+        {
+          states_idx_t q0_idx = t.first.first;
+          letter_idx_t l_idx  = t.first.second;
+          letter_t     l      = alphabet_[l_idx];
+          states_idx_t q1_idx = t.second;
+          unsigned int epp    = Epp{}(l);
+
+          if (productive.find(q1_idx) == productive.end()) continue;
+
+          // insert state
+          state_states_map_[q0_idx].states.push_back(q1_idx);
+
+          // insert letter
+          auto trn_k = std::make_pair(q0_idx, q1_idx);
+          auto epp_k = std::make_pair(trn_k, epp);
+          if (trans_epp_m.find(trn_k) == trans_epp_m.end())
+            {
+              std::vector<std::vector<letter_idx_t>> lts_v{{l_idx}};
+              trans_epp_m.insert(std::make_pair(trn_k, lts_v));
+              epp_m.insert(std::make_pair(epp_k, 0));
+            }
+          else
+            {
+              auto &lts_v = trans_epp_m.at(trn_k);
+              if (epp_m.find(epp_k) == epp_m.end())
+                {
+                  lts_v.push_back(std::vector<letter_idx_t>{l_idx});
+                  epp_m.insert(std::make_pair(epp_k, lts_v.size() - 1));
+                }
+              else
+                lts_v[epp_m.at(epp_k)].push_back(l_idx);
+            }
+        }
+
+      // sort letters
+      for (auto &t : trans_epp_m)
+        trans_letters_map_.insert(std::make_pair(t.first, letters(t.second)));
+
+      index_weights();
+      index_mask();
+    };
+
+    // letters of a transition from their Epp partitions (sorted in
+    // place), the weights are set by weigh
+    letters_t letters(std::vector<std::vector<letter_idx_t>> &epp_v) const
+    {
+      letters_t lts_v;
+      for (auto &p : epp_v)
+        {
+          std::sort(p.begin(), p.end(), [&](unsigned int a, unsigned int b) { return alphabet_[a] < alphabet_[b]; });
+          lts_v.letters.insert(lts_v.letters.end(), p.begin(), p.end());
+        }
+      return lts_v;
+    };
+
+    // Epp partitions of the letters of a transition
+    std::vector<std::vector<letter_idx_t>> partitions(const std::vector<letter_idx_t> &lts_v) const
+    {
+      std::vector<std::vector<letter_idx_t>> res;
+      std::map<uint, size_t>                 epp_m;
+      for (auto lt : lts_v)
+        {
+          auto epp_i = epp_m.insert(std::make_pair(Epp{}(alphabet_[lt]), res.size())).first;
+          if (epp_i->second == res.size()) res.emplace_back();
+          res[epp_i->second].push_back(lt);
+        }
+      return res;
+    };
+
+    // weights and alias table of the letters of a transition, by
+    // default the letters of each of the P partitions weigh n / (P · m)
+    // (n letters, m in the partition) so that the transition weighs n
+    void weigh(letters_t &lts_v) const
+    {
+      const weight_t<T> &weight = lazy_ ? lazy_->weight : weight_;
+      const size_t       n      = lts_v.letters.size();
+      lts_v.weights.assign(n, 1.0);
+      if (weight)
+        for (size_t k = 0; k < n; k++)
+          lts_v.weights[k] = weight(alphabet_[lts_v.letters[k]]);
+      else
+        {
+          std::map<uint, size_t> epp_m;
+          for (auto lt : lts_v.letters)
+            epp_m[Epp{}(alphabet_[lt])]++;
+          for (size_t k = 0; k < n; k++)
+            lts_v.weights[k] = static_cast<double>(n) / static_cast<double>(epp_m.size() * epp_m.at(Epp{}(alphabet_[lts_v.letters[k]])));
+        }
+      lts_v.total = std::accumulate(lts_v.weights.begin(), lts_v.weights.end(), 0.0);
+      lts_v.alias = alias_t{lts_v.weights};
+    };
+
+    // alias tables of the transitions and of the successors (each one
+    // weighs the mean weight of the letters of its transition)
+    void index_weights()
+    {
+      for (auto &t : trans_letters_map_)
+        weigh(t.second);
+      for (auto &q : state_states_map_)
+        {
+          std::vector<double> w;
+          for (auto q1 : q.second.states)
+            {
+              const auto &lts_v = trans_letters_map_.at(std::make_pair(q.first, q1));
+              w.push_back(lts_v.total / static_cast<double>(lts_v.letters.size()));
+            }
+          q.second.alias = alias_t{w};
+        }
+    };
+
+    // state reached from q0 with letter l
+    regexp_t derive(const regexp_t &q0, const letter_t &l) const
+    {
+      return backend_ == backend_t::antimirov ? q0.pderivative(l) : q0.derivative(l);
+    };
+
     // add transition starting from q0 with letter l
     void build(const regexp_t &q0, states_idx_t q0_idx, const letter_t &l, letter_idx_t l_idx, regexp_map_t &regexp_map)
     {
-      const regexp_t q1{q0.derivative(l)};
+      const regexp_t q1{derive(q0, l)};
       if (q1 == regexp::RegExp<T>::zero) return;
       trans_t trans{q0_idx, l_idx};
       auto    q1_itr = regexp_map.find(q1);
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "fsm.h"
+
+namespace fsm
+{
+  //! Sampler over the tables of a rule compiled ahead of time
+  /*! Rule is a struct generated by tools/compile_rules.py whose
+   *  constexpr arrays (see compiled_t) have sizes known at compile time,
+   *  no regexp is derived and the sampling loops only index the arrays
+   *  and the alias tables of fixed size arrays.
+   *
+   *  The words are drawn as Fsm::sample: the walk stops on a final
+   *  state with probability 1/2, otherwise a successor is drawn in
+   *  proportion to the weight of its letters and then one of them in
+   *  proportion to its weight (by default the Epp partitions of the
+   *  letters of a successor are equi-probable). The letters of the
+   *  words are indices of Rule::letters.
+   */
+  template <typename Rule>
+  class StaticFsm
+  {
+  public:
+    //! Number of states
+    static constexpr unsigned int STATES = Rule::states;
+
+    //! Number of letters
+    static constexpr unsigned int LETTERS = Rule::letters_n;
+
+    //! Number of successors (over all the states)
+    static constexpr unsigned int SUCCESSORS = Rule::first[STATES + 1];
+
+    //! Number of transitions
+    static constexpr unsigned int TRANSITIONS = Rule::parts[Rule::succ[SUCCESSORS][1]];
+
+    StaticFsm()
+      : StaticFsm{(static_cast<uint64_t>(std::random_device{}()) << 32) | std::random_device{}()} {};
+
+    StaticFsm(uint64_t seed)
+      : rne_{seed}
+    {
+      setWeights({});
+    };
+
+    //! Seed the sampling random engine
+    void seed(uint64_t s)
+    {
+      rne_.seed(s);
+    };
+
+    //! Set the sampling weights of the letters (by name, see Fsm::setWeights)
+    void setWeights(const weight_t<std::string> &weight)
+    {
+      std::array<double, LETTERS> w;
+      for (unsigned int l = 0; l < LETTERS; l++)
+        {
+          w[l] = weight ? weight(Rule::letters[l]) : 1.0;
+          if (!(w[l] > 0.0) || w[l] == std::numeric_limits<double>::infinity())
+            throw std::invalid_argument{"letter weights must be positive"};
+        }
+
+      std::vector<double> ws;
+      for (unsigned int s = 0; s < SUCCESSORS; s++)
+        {
+          const unsigned int p0 = Rule::succ[s][1], p1 = Rule::succ[s + 1][1];
+          const unsigned int n  = Rule::parts[p1] - Rule::parts[p0];
+          ws.clear();
+          for (unsigned int p = p0; p < p1; p++)
+            for (unsigned int k = Rule::parts[p]; k < Rule::parts[p + 1]; k++)
+              ws.push_back(weight ? w[Rule::lts[k]] : static_cast<double>(n) / ((p1 - p0) * (Rule::parts[p + 1] - Rule::parts[p])));
+          letters_[s] = alias_t{ws};
+          total_[s]   = std::accumulate(ws.begin(), ws.end(), 0.0);
+        }
+
+      for (unsigned int q = 1; q <= STATES; q++)
+        {
+          ws.clear();
+          for (unsigned int s = Rule::first[q]; s < Rule::first[q + 1]; s++)
+            ws.push_back(total_[s]);
+          succ_[q] = alias_t{ws};
+        }
+    };
+
+    //! Walk a random path through the fsm and generate a word
+    std::vector<unsigned int> sample()
+    {
+      using dist_t = std::uniform_int_distribution<unsigned int>;
+      std::vector<unsigned int> res;
+      unsigned int              q = 1;
+      while (true)
+        {
+          const unsigned int s0   = Rule::first[q];
+          const unsigned int s1   = Rule::first[q + 1];
+          const bool         stop = Rule::finals[q];
+          if (stop && (s0 == s1 || dist_t{0, 1}(rne_) == 0)) break;
+          if (s0 == s1) throw std::runtime_error{"dangling state in fsm"};
+          const unsigned int s = s0 + static_cast<unsigned int>(succ_[q].draw(rne_));
+          res.push_back(Rule::lts[Rule::parts[Rule::succ[s][1]] + letters_[s].draw(rne_)]);
+          q = Rule::succ[s][0];
+        }
+      return res;
+    };
+
+    //! Match a word (letter indices) against the fsm
+    bool match(const std::vector<unsigned int> &w) const
+    {
+      unsigned int q = 1;
+      for (unsigned int l : w)
+        {
+          unsigned int q1 = 0;
+          for (unsigned int s = Rule::first[q]; q1 == 0 && s < Rule::first[q + 1]; s++)
+            for (unsigned int k = Rule::parts[Rule::succ[s][1]]; k < Rule::parts[Rule::succ[s + 1][1]]; k++)
+              if (Rule::lts[k] == l) q1 = Rule::succ[s][0];
+          if (q1 == 0) return false;
+          q = q1;
+        }
+      return Rule::finals[q];
+    };
+
+    //! Letter of the alphabet
+    static const char *letter(unsigned int idx)
+    {
+      return Rule::letters[idx];
+    };
+
+  private:
+    std::mt19937_64 rne_;
+
+    // successors of each state and letters of each successor drawn in
+    // proportion to their weights (total_ for a successor)
+    std::array<alias_t, STATES + 1> succ_;
+    std::array<alias_t, SUCCESSORS> letters_;
+    std::array<double, SUCCESSORS>  total_;
+  };
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace local_search
+{
+  //! Late acceptance hill climbing
+  /*! A mutation is accepted if the new energy is not worse than the
+   *  current energy or than the energy found length iterations ago.
+   */
+  struct late_acceptance
+  {
+    unsigned int        length;
+    std::vector<double> history = {};
+    unsigned int        k       = 0;
+
+    static const std::string name() { return "late acceptance"; };
+
+    void start(double e, unsigned int)
+    {
+      if (length == 0) throw std::invalid_argument{"late acceptance length must be positive"};
+      history.assign(length, e);
+      k = 0;
+    };
+
+    bool accept(double e, double de) const
+    {
+      return de <= 0.0 || e + de <= history[k];
+    };
+
+    void step(double e)
+    {
+      history[k] = e;
+      k          = (k + 1) % length;
+    };
+  };
+
+  //! Threshold accepting
+  /*! A mutation is accepted if the energy increases by less than a
+   *  threshold, the threshold starts as a fraction of the initial
+   *  energy and decreases linearly to zero.
+   */
+  struct threshold_accepting
+  {
+    double ratio;
+    double threshold = 0.0;
+    double decrement = 0.0;
+
+    static const std::string name() { return "threshold accepting"; };
+
+    void start(double e, unsigned int iterations)
+    {
+      if (ratio <= 0.0) throw std::invalid_argument{"threshold ratio must be positive"};
+      threshold = ratio * fabs(e);
+      decrement = threshold / std::max(iterations, 1u);
+    };
+
+    bool accept(double, double de) const
+    {
+      return de <= 0.0 || de < threshold;
+    };
+
+    void step(double)
+    {
+      threshold = std::max(0.0, threshold - decrement);
+    };
+  };
+
+  //! Record-to-record travel
+  /*! A mutation is accepted if the new energy exceeds the best energy
+   *  found (the record) by less than a fraction of the record.
+   */
+  struct record_to_record
+  {
+    double ratio;
+    double record = 0.0;
+
+    static const std::string name() { return "record-to-record travel"; };
+
+    void start(double e, unsigned int)
+    {
+      if (ratio <= 0.0) throw std::invalid_argument{"record deviation ratio must be positive"};
+      record = e;
+    };
+
+    bool accept(double e, double de) const
+    {
+      return de <= 0.0 || e + de < record + ratio * fabs(record);
+    };
+
+    void step(double e)
+    {
+      if (e < record) record = e;
+    };
+  };
+
+  //! Local search over a state with an acceptance criterion
+  /*! Unlike annealing these searches need no temperature calibration,
+   *  the state is mutated for a number of passes of nover iterations
+   *  and the search stops early when a whole pass has no accepted
+   *  mutation.
+   */
+  template <typename S, typename A>
+  class Search
+  {
+  public:
+    Search(unsigned int nover, S &state, const A &criterion)
+      : nover_{nover}
+      , state_{state}
+      , criterion_{criterion} {};
+
+    //! Perform the search
+    void search(unsigned int passes)
+    {
+      if (passes == 0) throw std::invalid_argument{"passes > 0"};
+
+      double e = state_.energy();
+      criterion_.start(e, passes * nover_);
+
+      std::cout
+        << "starting " << passes << " " << A::name() << " passes"
+        << " of " << nover_ << " iterations ..."
+        << "\n"
+        << std::flush;
+      for (unsigned int n = 1; n <= passes; n++)
+        {
+          unsigned int l = 0;
+          for (unsigned int k = 0; k < nover_; k++)
+            {
+              state_.mutate();
+              double de = state_.delta_energy();
+              if (criterion_.accept(e, de))
+                {
+                  state_.apply_mutation();
+                  e += de;
+                  l++;
+                }
+              criterion_.step(e);
+            }
+          // fix energy to avoid accumulation of numerical errors in de
+          e = state_.energy();
+
+          std::cout
+            << std::setw(3) << (100 * n / passes) << "%"
+            << " E=" << std::fixed << std::setprecision(4) << e
+            << " (" << l << " " << nover_ << ") ..."
+            << "\n"
+            << std::flush;
+
+          if (l == 0)
+            break;
+        }
+    };
+
+  private:
+    unsigned int nover_;
+    S &          state_;
+    A            criterion_;
+  };
+}
@@ -1,10 +1,12 @@
 #pragma once
 
 #include <algorithm>
+#include <cmath>
 #include <exception>
 #include <functional>
 #include <map>
 #include <string>
+#include <thread>
 #include <vector>
 #include <fstream>
 #include <iomanip>
@@ -13,6 +15,7 @@
 #include <boost/filesystem.hpp>
 
 #include "config.h"
+#include "segment_tree.h"
 #include "shift.h"
 #include "target.h"
 
@@ -30,11 +33,48 @@ namespace plan
     const double difference;
   };
 
+  //! A constant staffing change over the slots [slot0, slot1)
+  struct staffing_run_t
+  {
+    staffing_run_t(unsigned int s0, unsigned int s1, double d)
+      : slot0{s0}
+      , slot1{s1}
+      , delta{d} {};
+
+    unsigned int slot0;
+    unsigned int slot1;
+    double       delta;
+  };
+
+  //! Marks the current thread as a worker of a parallel job
+  /*! While a worker scope is alive the plans rebuilt on the thread
+   *  compute their staffing serially, the jobs already use the cores.
+   */
+  struct worker_scope
+  {
+    worker_scope()
+      : prev_{active}
+    {
+      active = true;
+    };
+
+    ~worker_scope()
+    {
+      active = prev_;
+    };
+
+    static inline thread_local bool active = false;
+
+  private:
+    bool prev_;
+  };
+
   //! The plan
   /*! The plan class contains:
    *
    *  - the target staffing curve
    *  - the current staffing curve
+   *  - segment trees over the staffing errors
    *  - the shift schedule for each agent
    *
    *  it is meant to be used in conjunction with the staff planner
@@ -51,11 +91,20 @@ namespace plan
     Plan(unsigned int offset, const std::vector<std::string> &agents, const target::Target &target)
       : target_{target.getTarget()}
       , target_unrescaled_{target.getUnrescaledTarget()}
+      , minimum_{target.getMinimum()}
+      , weights_{target.getWeights()}
+      , scenarios_{target.getScenarios()}
+      , scenarios_lambda_{target.getScenariosLambda()}
       , staffing_(target_.size(), 0.0)
+      , errors_{}
+      , slack_{}
       , plan_{agents.size(), line_t{}}
+      , contract_hours_(agents.size(), -1.0)
+      , agent_team_(agents.size(), 0)
       , days_{target.days()}
       , offset_{0}
       , agent_idx_map_{}
+      , team_idx_map_{{"", 0}}
     {
       if (agents.empty()) throw std::invalid_argument{"you must add agents to create a plan"};
 
@@ -72,6 +121,8 @@ namespace plan
             plan_[i].push_back(shift::Shift{});
           i++;
         }
+
+      resetErrors();
     };
 
     //! Target staffing curve (rescaled)
@@ -80,12 +131,118 @@ namespace plan
     //! Target staffing curve (unrescaled)
     std::vector<double> target_unrescaled_;
 
+    //! Minimum staffing curve
+    std::vector<double> minimum_;
+
+    //! Staffing error weights
+    std::vector<double> weights_;
+
+    //! Demand scenarios (perturbed target curves)
+    std::vector<std::vector<double>> scenarios_;
+
+    //! Robust energy standard deviation factor
+    double scenarios_lambda_;
+
     //! Planned staffing curve
     std::vector<double> staffing_;
 
+    //! Staffing errors (staffing - target)
+    segment_tree::SegmentTree errors_;
+
+    //! Staffing slack over the minimum (staffing - minimum)
+    segment_tree::SegmentTree slack_;
+
+    //! Rebuild the error trees from the staffing curve
+    void resetErrors()
+    {
+      std::vector<double> err(staffing_.size(), 0.0);
+      std::vector<double> slk(staffing_.size(), 0.0);
+      for (unsigned int i = 0; i < staffing_.size(); i++)
+        {
+          err[i] = staffing_[i] - target_[i];
+          slk[i] = staffing_[i] - minimum_[i];
+        }
+      errors_ = segment_tree::SegmentTree{err};
+      slack_  = segment_tree::SegmentTree{slk};
+    };
+
+    //! Staffing curve rebuilt from the agents lines
+    /*! Agents are split in contiguous blocks, each thread accumulates
+     *  the shifts events of its block in a difference array, the arrays
+     *  are then summed and the staffing is recovered with a single
+     *  prefix sum (threads 0 uses the available cores, or the calling
+     *  thread only inside a worker scope).
+     */
+    std::vector<double> computeStaffing(unsigned int threads = 0) const
+    {
+      if (threads == 0) threads = worker_scope::active ? 1 : std::thread::hardware_concurrency();
+      threads = std::max<size_t>(1, std::min<size_t>(threads, plan_.size() / STAFFING_BLOCK));
+      const size_t block = (plan_.size() + threads - 1) / threads;
+
+      std::vector<std::vector<double>> diff(threads, std::vector<double>(staffing_.size() + 1, 0.0));
+      auto                             accumulate = [&](size_t t) {
+        for (size_t a = t * block; a < std::min((t + 1) * block, plan_.size()); a++)
+          for (unsigned int day = 0; day < plan_[a].size(); day++)
+            plan_[a][day].add_events(day, +1, diff[t]);
+      };
+
+      std::vector<std::thread> workers;
+      for (size_t t = 1; t < threads; t++)
+        workers.emplace_back(accumulate, t);
+      accumulate(0);
+      for (auto &w : workers)
+        w.join();
+
+      for (size_t t = 1; t < threads; t++)
+        for (size_t i = 0; i < staffing_.size(); i++)
+          diff[0][i] += diff[t][i];
+
+      std::vector<double> stf(staffing_.size(), 0.0);
+      double              s = 0.0;
+      for (size_t i = 0; i < stf.size(); i++)
+        {
+          s += diff[0][i];
+          stf[i] = s;
+        }
+      return stf;
+    };
+
+    //! Rebuild the staffing curve and the error trees from the agents lines
+    void recomputeStaffing()
+    {
+      staffing_ = computeStaffing();
+      resetErrors();
+    };
+
+    //! Maximum difference between the maintained and the rebuilt staffing
+    double staffingDrift() const
+    {
+      std::vector<double> stf   = computeStaffing();
+      double              drift = 0.0;
+      for (size_t i = 0; i < stf.size(); i++)
+        drift = std::max(drift, std::fabs(stf[i] - staffing_[i]));
+      return drift;
+    };
+
+    //! Update the error trees after a staffing change
+    void updateErrors(const std::vector<staffing_run_t> &runs)
+    {
+      for (const auto &r : runs)
+        {
+          errors_.add(r.slot0, r.slot1, r.delta);
+          slack_.add(r.slot0, r.slot1, r.delta);
+        }
+    };
+
     //! Plan
     std::vector<line_t> plan_;
 
+    //! Weekly contract hours for each agent (negative if not set)
+    std::vector<double> contract_hours_;
+
+    //! Team index for each agent (agents without a team share team 0)
+    std::vector<unsigned int> agent_team_;
+
     //! Plan length in days
     unsigned int days() const
     {
@@ -163,13 +320,27 @@ namespace plan
       return plan_hours_t{s_trg / 60, s_stf / 60, 100 * (s_trg - s_stf) / s_trg};
     };
 
-    //! Daily energy (mean squared difference between target and staffing)
+    //! Weekly coverage (fraction of the target staffing covered)
+    double coverage(unsigned int week) const
+    {
+      if (week * 7 > days_) throw std::invalid_argument{"week exceeds plan length"};
+      double s_trg = 0.0;
+      double s_cov = 0.0;
+      for (unsigned int i = week * 7 * SLOTS_DAY; i < (week + 1) * 7 * SLOTS_DAY && i < target_.size(); i++)
+        {
+          s_trg += target_[i];
+          s_cov += std::min(target_[i], staffing_[i]);
+        }
+      return s_trg > 0.0 ? s_cov / s_trg : 1.0;
+    };
+
+    //! Daily energy (weighted mean squared difference between target and staffing)
     double energy(unsigned int day) const
     {
       if (day > days_) throw std::invalid_argument{"day exceed plan length"};
       double e = 0.0;
       for (unsigned int i = day * SLOTS_DAY; i < (day + 1) * SLOTS_DAY && i < staffing_.size(); i++)
-        e += (target_[i] - staffing_[i]) * (target_[i] - staffing_[i]);
+        e += weights_[i] * (target_[i] - staffing_[i]) * (target_[i] - staffing_[i]);
       return e / SLOTS_DAY;
     };
 
@@ -182,11 +353,50 @@ namespace plan
       return agt->second;
     };
 
+    //! Get code of agent at plan index
+    const std::string &getAgentCode(unsigned int agent_idx) const
+    {
+      for (const auto &a : agent_idx_map_)
+        if (a.second == agent_idx) return a.first;
+      throw std::invalid_argument{"agent not found in plan"};
+    };
+
+    //! Set weekly contract hours for agent
+    void setAgentContract(const std::string &agent_code, double weekly_hours)
+    {
+      if (weekly_hours < 0.0) throw std::invalid_argument{"contract hours must be positive"};
+      contract_hours_[getAgentIndex(agent_code)] = weekly_hours;
+    };
+
+    //! Set team for agent
+    void setAgentTeam(const std::string &agent_code, const std::string &team)
+    {
+      auto t = team_idx_map_.find(team);
+      if (t == team_idx_map_.end())
+        t = team_idx_map_.insert(std::make_pair(team, static_cast<uint>(team_idx_map_.size()))).first;
+      agent_team_[getAgentIndex(agent_code)] = t->second;
+    };
+
+    //! Number of teams
+    unsigned int teams() const
+    {
+      return team_idx_map_.size();
+    };
+
+    //! Hours worked by agent in days [day0, day1)
+    double agentHours(unsigned int agent_idx, unsigned int day0, unsigned int day1) const
+    {
+      double h = 0.0;
+      for (unsigned int day = day0; day < day1 && day < plan_[agent_idx].size(); day++)
+        h += plan_[agent_idx][day].hours();
+      return h;
+    };
+
     //! Update agent plan starting from day
     void updatePlan(unsigned int agent_idx, unsigned int day, const line_t &plan)
     {
       if (day > days_) throw std::invalid_argument{"day exceed plan length"};
-      for (unsigned int i = 0; i < plan.size() && day + i < plan_.size(); i++)
+      for (unsigned int i = 0; i < plan.size() && day + i < plan_[agent_idx].size(); i++)
         plan_[agent_idx][day + i] = plan[i];
     };
 
@@ -252,6 +462,7 @@ namespace plan
     unsigned int offset_;
 
     std::map<std::string, uint> agent_idx_map_;
+    std::map<std::string, uint> team_idx_map_;
   };
 
   // Stream output
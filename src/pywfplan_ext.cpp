@@ -1,5 +1,6 @@
 #include <exception>
 #include <optional>
+#include <sstream>
 #include <string>
 #include <vector>
 #include <map>
@@ -11,6 +12,8 @@
 #include "shift.h"
 #include "target.h"
 #include "plan.h"
+#include "scenarios.h"
+#include "scoring.h"
 #include "staff_planner.h"
 #include "fsm.h"
 
@@ -124,6 +127,17 @@ struct to_python_list
   }
 };
 
+template <typename T>
+struct to_python_pair
+{
+  static PyObject *convert(const T &pair)
+  {
+    namespace bp = boost::python;
+
+    return bp::incref(bp::make_tuple(pair.first, pair.second).ptr());
+  }
+};
+
 template <typename K, typename V>
 struct to_python_dict
 {
@@ -139,6 +153,57 @@ struct to_python_dict
   }
 };
 
+// Release the GIL for the lifetime of the object
+class gil_release
+{
+public:
+  gil_release()
+    : state_{PyEval_SaveThread()} {};
+
+  ~gil_release()
+  {
+    PyEval_RestoreThread(state_);
+  };
+
+private:
+  PyThreadState *state_;
+};
+
+// Score plans without holding the GIL (arguments are converted before)
+std::vector<scoring::score_t> score_plans(const target::Target &target, const std::vector<shift::Shift> &shifts, const std::vector<std::vector<std::vector<int>>> &plans, unsigned int week)
+{
+  gil_release release;
+  return scoring::score(target, shifts, plans, week);
+}
+
+// Compile the agents samplers without holding the GIL (arguments are converted before)
+std::vector<staff_planner::rule_stat_t> set_agent_samplers(staff_planner::StaffPlanner &planner, const std::vector<std::string> &agents, const std::vector<regexp::RegExp<shift::Shift>> &regexps, const std::vector<std::string> &backends)
+{
+  gil_release release;
+  return planner.setAgentSamplers(agents, regexps, backends);
+}
+
+// Compile a rule into the constexpr tables of a C++ header (see tools/compile_rules.py)
+std::string compile_rule(const regexp::RegExp<shift::Shift> &rule, const std::string &name, const std::string &backend)
+{
+  std::stringstream ss;
+  staff_planner::sampler_t{rule, false, fsm::to_backend(backend)}.print_compiled(ss, name);
+  return ss.str();
+}
+
+// Set the sampling weights of the letters of a string fsm (the letters not given weigh 1)
+void fsm_set_weights(fsm::Fsm<std::string> &f, const std::vector<std::string> &letters, const std::vector<double> &weights)
+{
+  if (letters.size() != weights.size()) throw std::invalid_argument{"letters and weights must have the same size"};
+  std::map<std::string, double> weight_m;
+  for (size_t i = 0; i < letters.size(); i++)
+    weight_m[letters[i]] = weights[i];
+  f.setWeights(letters.empty() ? fsm::weight_t<std::string>{} : [weight_m](const std::string &l) {
+    const auto w_i = weight_m.find(l);
+    return w_i == weight_m.end() ? 1.0 : w_i->second;
+  });
+}
+
 BOOST_PYTHON_MODULE(pywfplan_ext)
 {
   using namespace shift;
@@ -155,7 +220,10 @@ BOOST_PYTHON_MODULE(pywfplan_ext)
   iterable_converter()
     .from_python<std::vector<Shift>>()
     .from_python<std::vector<std::vector<int>>>()
+    .from_python<std::vector<std::vector<double>>>()
+    .from_python<std::vector<std::vector<std::vector<int>>>>()
     .from_python<std::vector<std::string>>()
+    .from_python<std::vector<RegExp<Shift>>>()
     .from_python<std::vector<double>>()
     .from_python<std::vector<int>>();
 
@@ -164,6 +232,12 @@ BOOST_PYTHON_MODULE(pywfplan_ext)
   to_python_converter<std::vector<std::string>, to_python_list<std::vector<std::string>>>();
   to_python_converter<std::vector<Shift>, to_python_list<std::vector<Shift>>>();
   to_python_converter<std::unordered_set<Shift>, to_python_list<std::unordered_set<Shift>>>();
+  to_python_converter<Shift::span_t, to_python_pair<Shift::span_t>>();
+  to_python_converter<std::vector<Shift::span_t>, to_python_list<std::vector<Shift::span_t>>>();
+  to_python_converter<std::vector<sweep_point_t>, to_python_list<std::vector<sweep_point_t>>>();
+  to_python_converter<std::vector<scoring::score_t>, to_python_list<std::vector<scoring::score_t>>>();
+  to_python_converter<std::vector<rule_stat_t>, to_python_list<std::vector<rule_stat_t>>>();
+  to_python_converter<std::map<std::string, unsigned int>, to_python_dict<std::string, unsigned int>>();
 
   // register exception translators
   register_exception_translator<AttributeError>(&translate);
@@ -171,14 +245,20 @@ BOOST_PYTHON_MODULE(pywfplan_ext)
 
   // --------------------------------------------------------------------------------
 
-  class_<Shift>("ShiftExt", "A work/rest shift to be assigned to an agent", init<std::string, std::vector<std::vector<int>>>())
+  class_<Shift>("ShiftExt", "A work/rest shift to be assigned to an agent", init<std::string, std::vector<std::vector<int>>, optional<unsigned int, std::vector<std::vector<int>>>>())
     .def("__repr__", &Shift::to_string)
     .def("__eq__",   &Shift::operator==)
     .def("__ne__",   &Shift::operator!=)
-    .def("code",     &Shift::code, "Get shift code")
-    .def("work",     &Shift::work, "Check whether it is a work shift")
-    .def("t0",       &Shift::t0,   "Enter time in minutes")
-    .def("t1",       &Shift::t1,   "Exit time in minutes");
+    .def("code",     &Shift::code,     "Get shift code")
+    .def("work",     &Shift::work,     "Check whether it is a work shift")
+    .def("t0",       &Shift::t0,       "Enter time in minutes")
+    .def("t1",       &Shift::t1,       "Exit time in minutes")
+    .def("hours",    &Shift::hours,    "Working hours")
+    .def("flags",    &Shift::flags,    "Shift flags")
+    .def("flexible", &Shift::flexible, "Check whether the shift has flexible breaks")
+    .def("breaks",   &Shift::breaks,   "Placed flexible breaks as (start, end) minutes")
+    .def_readonly("FLAG_LATE",  &Shift::FLAG_LATE)
+    .def_readonly("FLAG_NIGHT", &Shift::FLAG_NIGHT);
 
   // --------------------------------------------------------------------------------
   using regexp_t = RegExp<Shift>;
@@ -198,27 +278,80 @@ BOOST_PYTHON_MODULE(pywfplan_ext)
   // --------------------------------------------------------------------------------
 
   class_<Target>("TargetExt", "The staffing target curve", init<unsigned int, unsigned int, std::vector<double>>())
-    .def("__repr__", &Target::to_string);
+    .def("__repr__",     &Target::to_string)
+    .def("setMinimum",   &Target::setMinimum,   "Set the minimum staffing curve")
+    .def("setWeights",   &Target::setWeights,   "Set the staffing error weights")
+    .def("setScenarios", &Target::setScenarios, "Set the demand scenarios and the robust energy lambda")
+    .def("resample",     &Target::resample,     "Subsample a curve to 5 minutes slots");
 
   // --------------------------------------------------------------------------------
 
   class_<Plan>("PlanExt", "The staffing plan", init<unsigned int, std::vector<std::string>, Target>())
     .def("__repr__",           &Plan::to_string)
+    .def("setAgentContract",   &Plan::setAgentContract,   "Set weekly contract hours for agent")
+    .def("setAgentTeam",       &Plan::setAgentTeam,       "Set team for agent")
     .def("savePlan",           &Plan::savePlan,           "Save whole plan to file")
     .def("getAgentPlan",       &Plan::getAgentPlan,       "Get plan for agent")
     .def("saveStaffing",       &Plan::saveStaffing,       "Save staffing curves to file")
     .def("getTargetStaffing",  &Plan::getTargetStaffing,  "Get the (rescaled) target staffing curve")
-    .def("getPlannedStaffing", &Plan::getPlannedStaffing, "Get the planned staffing curve");
+    .def("getPlannedStaffing", &Plan::getPlannedStaffing, "Get the planned staffing curve")
+    .def("scenarioEnergies",   &scenarios::energies,      "Get the week staffing energy against each demand scenario")
+    .def("recomputeStaffing",  &Plan::recomputeStaffing,  "Rebuild the staffing curve from the agents plans")
+    .def("staffingDrift",      &Plan::staffingDrift,      "Maximum difference between the maintained and the rebuilt staffing");
+
+  // --------------------------------------------------------------------------------
+
+  class_<sweep_point_t>("SweepPointExt", "A point of the comfort weight sweep", no_init)
+    .def_readonly("comfort_weight",  &sweep_point_t::comfort_weight)
+    .def_readonly("staffing_energy", &sweep_point_t::staffing_energy)
+    .def_readonly("comfort_energy",  &sweep_point_t::comfort_energy)
+    .def_readonly("seconds",         &sweep_point_t::seconds)
+    .add_property("plan",            make_getter(&sweep_point_t::plan, return_value_policy<return_by_value>()));
+
+  class_<scoring::score_t>("ScoreExt", "The energies of a scored plan", no_init)
+    .def_readonly("staffing_energy", &scoring::score_t::staffing_energy)
+    .def_readonly("comfort_energy",  &scoring::score_t::comfort_energy)
+    .add_property("day_energies",    make_getter(&scoring::score_t::day_energies, return_value_policy<return_by_value>()));
+
+  def("scorePlans", score_plans, "Score plans given as shift index matrices (in parallel, without the GIL)");
+
+  def("compileRule", compile_rule, "Compile a rule into the constexpr tables of a C++ header");
+
+  // --------------------------------------------------------------------------------
+
+  class_<rule_stat_t>("RuleStatExt", "The compilation of an agents rule", no_init)
+    .def_readonly("rule",        &rule_stat_t::rule)
+    .def_readonly("backend",     &rule_stat_t::backend)
+    .def_readonly("precompiled", &rule_stat_t::precompiled)
+    .def_readonly("agents",      &rule_stat_t::agents)
+    .def_readonly("states",      &rule_stat_t::states)
+    .def_readonly("transitions", &rule_stat_t::transitions)
+    .def_readonly("seconds",     &rule_stat_t::seconds);
 
   // --------------------------------------------------------------------------------
 
   class_<StaffPlanner>("StaffPlannerExt", "The planner itself", init<std::string, Plan, double, double>())
-    .def("__repr__", &StaffPlanner::to_string)
-    .def("run",             &StaffPlanner::run,             "Run simulation")
-    .def("setAgentSampler", &StaffPlanner::setAgentSampler, "Set a sampler for an agent")
-    .def("setWeek",         &StaffPlanner::setWeek,         "Set week to plan")
-    .def("getPlan",         &StaffPlanner::getPlan,         "Retrieve the optimized plan")
-    .def("getReport",       &StaffPlanner::getReport,       "Get the planning report");
+    .def("__repr__",             &StaffPlanner::to_string)
+    .def("run",                  &StaffPlanner::run,                  "Run simulation")
+    .def("setAgentSampler",      &StaffPlanner::setAgentSampler,      "Set a sampler for an agent")
+    .def("setAgentSamplers",     set_agent_samplers,                  "Set the samplers of many agents (compiled in parallel, without the GIL)")
+    .def("setAgentAvailability", &StaffPlanner::setAgentAvailability, "Set the shifts an agent is available for on a day")
+    .def("setLazySamplers",      &StaffPlanner::setLazySamplers,      "Build the samplers states on demand (after a warm-up)")
+    .def("setShiftWeights",      &StaffPlanner::setShiftWeights,      "Set the sampling weights of the shifts (by code)")
+    .def("setWeek",              &StaffPlanner::setWeek,              "Set week to plan")
+    .def("setDeviationWeight",   &StaffPlanner::setDeviationWeight,   "Set deviation energy weight")
+    .def("setContractWeight",    &StaffPlanner::setContractWeight,    "Set contract hours energy weight")
+    .def("setFairnessWeight",    &StaffPlanner::setFairnessWeight,    "Set fairness energy weight")
+    .def("setRobustWeight",      &StaffPlanner::setRobustWeight,      "Set robust energy weight")
+    .def("setMinimumRest",       &StaffPlanner::setMinimumRest,       "Set minimum rest between shifts (in minutes)")
+    .def("setEvolution",         &StaffPlanner::setEvolution,         "Set population size and generations of the evolutionary mode")
+    .def("setEngine",            &StaffPlanner::setEngine,            "Set optimization engine (anneal, lahc, threshold, rrt)")
+    .def("setRepairSize",        &StaffPlanner::setRepairSize,        "Set number of agents freed by the large neighbourhood move")
+    .def("setColdPhase",         &StaffPlanner::setColdPhase,         "Set acceptance ratio below which the annealing is rejection-free")
+    .def("sweep",                &StaffPlanner::sweep,                "Sweep the comfort weight and get the non dominated plans")
+    .def("sizing",               &StaffPlanner::sizing,               "Find the minimum headcount of each agents class")
+    .def("getPlan",              &StaffPlanner::getPlan,              "Retrieve the optimized plan")
+    .def("getReport",            &StaffPlanner::getReport,            "Get the planning report");
 
   // --------------------------------------------------------------------------------
 
@@ -233,6 +366,7 @@ BOOST_PYTHON_MODULE(pywfplan_ext)
     .def("__ne__",     &str_re_t::operator!=)
     .def("is_literal", &str_re_t::is_literal, "Check if regexp is literal")
     .def("alphabet",   &str_re_t::alphabet,   "Extract the alphabet from a regexp")
+    .def("size",       &str_re_t::size,       "Number of nodes of the regexp")
     .def("kstar",      &str_re_t::kstar,      "Kleene star")
     .def(self * self)
     .def(self + self)
@@ -245,8 +379,17 @@ BOOST_PYTHON_MODULE(pywfplan_ext)
 
   using str_fsm_t = Fsm<std::string, default_epp<std::string>>;
 
-  class_<str_fsm_t>("FsmExt", "Finite state machine", init<str_re_t>())
-    .def("__repr__",   &str_fsm_t::to_string)
-    .def("sample",     &str_fsm_t::sample, "Walk a random path through the fsm and generate a word")
-    .def("match",      &str_fsm_t::match, "Match a word against the fsm");
+  enum_<backend_t>("Backend")
+    .value("brzozowski", backend_t::brzozowski)
+    .value("antimirov",  backend_t::antimirov);
+
+  class_<str_fsm_t>("FsmExt", "Finite state machine", init<str_re_t, optional<bool, backend_t>>())
+    .def("__repr__",    &str_fsm_t::to_string)
+    .def("sample",      &str_fsm_t::sample, "Walk a random path through the fsm and generate a word")
+    .def("match",       &str_fsm_t::match, "Match a word against the fsm")
+    .def("setWeights",  fsm_set_weights, "Set the sampling weights of the letters (the others weigh 1)")
+    .def("lazy",        &str_fsm_t::lazy, "Check whether the states are built on demand")
+    .def("warmup",      &str_fsm_t::warmup, "Build the states up to some transitions from the start")
+    .def("states",      &str_fsm_t::states, "Number of states (built so far when lazy)")
+    .def("transitions", &str_fsm_t::transitions, "Number of transitions (built so far when lazy)");
 }
@@ -57,6 +57,9 @@ public:
   //! Hash
   size_t hash() const { return rex_->hash(); };
 
+  //! Number of nodes
+  size_t size() const { return rex_->size(); };
+
   //! Assignment
   RegExp<T> &operator=(const RegExp<T> &r)
   {
@@ -131,6 +134,19 @@ public:
     return RegExp<T>{rex_->derivative(x)};
   };
 
+  //! Sum of the partial derivatives with respect to a letter
+  /*! The partial derivatives (Antimirov) are the states of a linear
+   *  size nfa, their sum is a state of the determinised nfa.
+   */
+  const RegExp<T> pderivative(const T &x) const
+  {
+    regexp_impl::rex_ptr_set_t<T> ps;
+    rex_->pderivative(x, ps);
+    if (ps.empty()) return zero;
+    if (ps.size() == 1) return RegExp<T>{*ps.begin()};
+    return RegExp<T>{std::make_shared<regexp_impl::Sum<T>>(ps)};
+  };
+
   //! Derivative with respect to a word
   const RegExp<T> derivative(const std::vector<T> &w) const
   {
@@ -5,8 +5,10 @@
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <numeric>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -21,7 +23,124 @@ using rex_t = uint;
 template <typename T>
 using rex_ptr_t = typename std::shared_ptr<Rex<T>>;
 
+template <typename T>
+struct rex_ptr_hash : std::unary_function<rex_ptr_t<T>, std::size_t>
+{
+  size_t operator()(rex_ptr_t<T> r) const { return r->hash(); };
+};
+
+template <typename T>
+struct rex_ptr_eq : std::binary_function<rex_ptr_t<T>, rex_ptr_t<T>, bool>
+{
+  bool operator()(rex_ptr_t<T> r, rex_ptr_t<T> s) const { return r->equal(s); };
+};
+
+template <typename T>
+using rex_ptr_set_t = typename std::unordered_set<rex_ptr_t<T>, rex_ptr_hash<T>, rex_ptr_eq<T>>;
+
+template <typename T>
+using rex_ptr_vec_t = typename std::vector<rex_ptr_t<T>>;
+
+//! Interned letter identifier
+using letter_id_t = uint;
+
+//! Letters interned to dense ids
+/*! The ids are shared by all the regexps over a type and stay valid
+ *  for the whole process, the table is guarded since regexps may be
+ *  derived from several threads. Equal letters share an id even when
+ *  they differ otherwise (e.g. shifts with other flags), so the ids
+ *  only index the letter sets and never stand for the letters.
+ */
+template <typename T>
+class Letters
+{
+public:
+  //! Id of a letter (interned on first use)
+  static letter_id_t id(const T &l)
+  {
+    std::lock_guard<std::mutex> lock{table().mutex};
+    const auto                  it = table().ids.find(l);
+    if (it != table().ids.end()) return it->second;
+    const letter_id_t i = table().ids.size();
+    table().ids.emplace(l, i);
+    return i;
+  };
+
+private:
+  struct table_t
+  {
+    std::mutex                         mutex;
+    std::unordered_map<T, letter_id_t> ids;
+  };
+
+  static table_t &table()
+  {
+    static table_t t;
+    return t;
+  };
+};
+
+//! Set of interned letters
+/*! The first 64 ids are kept inline so that the set of a node over a
+ *  small alphabet does not allocate.
+ */
+class letter_set_t
+{
+public:
+  //! Add a letter
+  void set(letter_id_t i)
+  {
+    if (i < 64)
+      w0_ |= uint64_t{1} << i;
+    else
+    {
+      const size_t w = i / 64 - 1;
+      if (ws_.size() <= w) ws_.resize(w + 1, 0);
+      ws_[w] |= uint64_t{1} << (i % 64);
+    }
+  };
+
+  //! Check if a letter is in the set
+  bool test(letter_id_t i) const
+  {
+    if (i < 64) return (w0_ >> i) & 1;
+    const size_t w = i / 64 - 1;
+    return w < ws_.size() && ((ws_[w] >> (i % 64)) & 1);
+  };
+
+  //! Union
+  letter_set_t &operator|=(const letter_set_t &o)
+  {
+    w0_ |= o.w0_;
+    if (ws_.size() < o.ws_.size()) ws_.resize(o.ws_.size(), 0);
+    for (size_t w = 0; w < o.ws_.size(); w++)
+      ws_[w] |= o.ws_[w];
+    return *this;
+  };
+
+  //! Check if the sets share a letter
+  bool intersects(const letter_set_t &o) const
+  {
+    if (w0_ & o.w0_) return true;
+    for (size_t w = 0; w < std::min(ws_.size(), o.ws_.size()); w++)
+      if (ws_[w] & o.ws_[w]) return true;
+    return false;
+  };
+
+private:
+  uint64_t              w0_ = 0;
+  std::vector<uint64_t> ws_;
+};
+
+template <typename T>
+class Zer;
+
 //! Regular Expression base virtual implementation class
+/*! The nodes are immutable, their hash, nullable flag, size and
+ *  letters are computed once by the constructors (from the children
+ *  ones) and derivatives by a letter that does not occur in a node are
+ *  ∅ without walking it.
+ */
 template <typename T>
 class Rex
 {
@@ -38,35 +157,66 @@ public:
   virtual bool equal(rex_ptr_t<T>) const = 0;
 
   //! Hash
-  virtual size_t hash() const = 0;
+  size_t hash() const { return hash_; };
 
   //! Check if regexp is nullable
-  virtual bool nullable() const = 0;
+  bool nullable() const { return nullable_; };
+
+  //! Number of nodes
+  size_t size() const { return size_; };
+
+  //! Letters occurring in the regexp
+  const letter_set_t &letters() const { return letters_; };
 
   //! Regexp derivative with respect to a letter
-  virtual rex_ptr_t<T> derivative(const T &) const = 0;
+  rex_ptr_t<T> derivative(const T &x) const { return derivative(x, Letters<T>::id(x)); };
+
+  //! Regexp derivative with respect to an interned letter
+  rex_ptr_t<T> derivative(const T &x, letter_id_t i) const
+  {
+    if (!letters_.test(i)) return Zer<T>::Instance;
+    return derive(x, i);
+  };
+
+  //! Regexp partial derivatives with respect to a letter
+  /*! The partial derivatives (Antimirov) are the terms whose sum is
+   *  the derivative, they are added to the set.
+   */
+  void pderivative(const T &x, rex_ptr_set_t<T> &ps) const { pderivative(x, Letters<T>::id(x), ps); };
+
+  //! Regexp partial derivatives with respect to an interned letter
+  void pderivative(const T &x, letter_id_t i, rex_ptr_set_t<T> &ps) const
+  {
+    if (letters_.test(i)) pderive(x, i, ps);
+  };
 
   //! Traverse expression tree to literal
   virtual void traverse(std::function<void(const T &)>) const = 0;
-};
 
-template <typename T>
-struct rex_ptr_hash : std::unary_function<rex_ptr_t<T>, std::size_t>
-{
-  size_t operator()(rex_ptr_t<T> r) const { return r->hash(); };
-};
+protected:
+  //! Derivative of a node whose letters contain the letter
+  virtual rex_ptr_t<T> derive(const T &, letter_id_t) const = 0;
 
-template <typename T>
-struct rex_ptr_eq : std::binary_function<rex_ptr_t<T>, rex_ptr_t<T>, bool>
-{
-  bool operator()(rex_ptr_t<T> r, rex_ptr_t<T> s) const { return r->equal(s); };
-};
+  //! Partial derivatives of a node whose letters contain the letter
+  virtual void pderive(const T &, letter_id_t, rex_ptr_set_t<T> &) const = 0;
 
-template <typename T>
-using rex_ptr_set_t = typename std::unordered_set<rex_ptr_t<T>, rex_ptr_hash<T>, rex_ptr_eq<T>>;
+  //! Set the cached metadata from the children
+  template <typename C>
+  void cache(const C &items)
+  {
+    size_ = 1;
+    for (const auto &r : items)
+    {
+      size_ += r->size();
+      letters_ |= r->letters();
+    }
+  };
 
-template <typename T>
-using rex_ptr_vec_t = typename std::vector<rex_ptr_t<T>>;
+  size_t       hash_     = 0;
+  bool         nullable_ = false;
+  size_t       size_     = 1;
+  letter_set_t letters_;
+};
 
 //! Empty set: ∅
 template <typename T>
@@ -84,13 +234,12 @@ public:
 
   bool equal(rex_ptr_t<T> r) const { return r->type() == Type; };
 
-  size_t hash() const { return 0; };
-
-  bool nullable() const { return false; };
+  void traverse(std::function<void(const T &)>) const {};
 
-  rex_ptr_t<T> derivative(const T &) const { return Instance; };
+protected:
+  rex_ptr_t<T> derive(const T &, letter_id_t) const { return Instance; };
 
-  void traverse(std::function<void(const T &)>) const {};
+  void pderive(const T &, letter_id_t, rex_ptr_set_t<T> &) const {};
 };
 
 //! Empty string: ε
@@ -101,7 +250,11 @@ public:
   static rex_ptr_t<T> Instance;
   static const rex_t  Type = 2;
 
-  One(){};
+  One()
+  {
+    this->hash_     = 1;
+    this->nullable_ = true;
+  };
 
   rex_t type() const { return Type; };
 
@@ -109,13 +262,12 @@ public:
 
   bool equal(rex_ptr_t<T> r) const { return r->type() == Type; };
 
-  size_t hash() const { return 1; };
-
-  bool nullable() const { return true; };
+  void traverse(std::function<void(const T &)>) const {};
 
-  rex_ptr_t<T> derivative(const T &) const { return Zer<T>::Instance; };
+protected:
+  rex_ptr_t<T> derive(const T &, letter_id_t) const { return Zer<T>::Instance; };
 
-  void traverse(std::function<void(const T &)>) const {};
+  void pderive(const T &, letter_id_t, rex_ptr_set_t<T> &) const {};
 };
 
 //! Literal: a (a ∈ Σ)
@@ -126,7 +278,12 @@ public:
   static const rex_t Type = 3;
 
   Lit(T c)
-      : c{c} {};
+      : c{c}
+      , id_{Letters<T>::id(c)}
+  {
+    this->hash_ = std::hash<T>{}(c);
+    this->letters_.set(id_);
+  };
 
   rex_t type() const { return Type; };
 
@@ -138,22 +295,25 @@ public:
     return std::static_pointer_cast<const Lit<T>>(r)->letter() == c;
   };
 
-  size_t hash() const { return std::hash<T>{}(c); };
+  void traverse(std::function<void(const T &)> f) const { f(c); };
 
-  bool nullable() const { return false; };
+  // return underlying letter
+  const T letter() const { return c; };
 
-  rex_ptr_t<T> derivative(const T &x) const
+protected:
+  rex_ptr_t<T> derive(const T &, letter_id_t i) const
   {
-    return x == c ? One<T>::Instance : Zer<T>::Instance;
+    return i == id_ ? One<T>::Instance : Zer<T>::Instance;
   };
 
-  void traverse(std::function<void(const T &)> f) const { f(c); };
-
-  // return underlying letter
-  const T letter() const { return c; };
+  void pderive(const T &, letter_id_t i, rex_ptr_set_t<T> &ps) const
+  {
+    if (i == id_) ps.insert(One<T>::Instance);
+  };
 
 private:
-  const T c;
+  const T           c;
+  const letter_id_t id_;
 };
 
 //! Sum: r + s + t ...
@@ -166,22 +326,34 @@ public:
   //! Sum: r + s + t
   /*! the following simplification rules are implemented:
    *
-   * -     ∅ + r ≈ r
-   * -     r + ∅ ≈ r
-   * -     r + r ≈ r
-   * -     r + s ≈ s + r
-   * - r + s + t ≈ (r + s) + t
-   *             ≈  r + (s + t)
+   * -       ∅ + r ≈ r
+   * -       r + ∅ ≈ r
+   * -       r + r ≈ r
+   * -       r + s ≈ s + r
+   * -   r + s + t ≈ (r + s) + t
+   *               ≈  r + (s + t)
+   * -       ε + r ≈ r           (r nullable, r* + ε ≈ r*)
+   * -      ε + r+ ≈ r*
+   * - r + (r & s) ≈ r
+   * - a·r + a·s   ≈ a·(r + s)
    */
   static rex_ptr_t<T> make(rex_ptr_t<T> r, rex_ptr_t<T> s);
 
+  //! Sum of a set of terms (simplified as above)
+  static rex_ptr_t<T> make(const rex_ptr_set_t<T> &ts);
+
   Sum(rex_ptr_t<T> r, rex_ptr_t<T> s)
-      : items_{r, s} {};
+      : items_{r, s}
+  {
+    init();
+  };
 
   Sum(const rex_ptr_set_t<T> &items)
-      : items_{items} {
-            // TBD: check size
-        };
+      : items_{items}
+  {
+    // TBD: check size
+    init();
+  };
 
   rex_t type() const { return Type; };
 
@@ -208,52 +380,55 @@ public:
     return true;
   };
 
-  size_t hash() const
+  //! Add a regexp to a set of terms splitting the sums
+  static void insert(rex_ptr_t<T> r, rex_ptr_set_t<T> &ps)
   {
-    size_t seed = 0;
-    for (auto ptr : items_)
-      hash_combine(seed, 0x426a3d31, ptr->hash());
-    return seed;
+    if (r->type() == Type)
+      for (const auto &t : std::static_pointer_cast<const Sum>(r)->items())
+        ps.insert(t);
+    else if (r->type() != Zer<T>::Type)
+      ps.insert(r);
   };
 
-  bool nullable() const
+  void traverse(std::function<void(const T &)> f) const
   {
-    return std::any_of(std::begin(items_), std::end(items_), [](rex_ptr_t<T> r) { return r->nullable(); });
+    for (auto p : items_)
+      p->traverse(f);
   };
 
+  const rex_ptr_set_t<T> items() const { return items_; }
+
+protected:
   // ∂a (r + s) ≡ ∂a r + ∂a s
-  rex_ptr_t<T> derivative(const T &x) const
+  rex_ptr_t<T> derive(const T &x, letter_id_t i) const
   {
     rex_ptr_set_t<T> ds;
     for (const auto &r : items_)
-    {
-      rex_ptr_t<T> d = r->derivative(x);
-      if (d->type() != Zer<T>::Type)
-        ds.insert(d);
-    }
-    if (ds.empty())
-      return Zer<T>::Instance;
-
-    if (ds.size() == 1)
-      return *ds.begin();
-
-    return std::accumulate(
-        ds.begin(),
-        ds.end(),
-        Zer<T>::Instance,
-        [](const rex_ptr_t<T> &a, const rex_ptr_t<T> &b) { return make(a, b); });
+      insert(r->derivative(x, i), ds);
+    return make(ds);
   };
 
-  void traverse(std::function<void(const T &)> f) const
+  // ∂a (r + s) ≡ ∂a r ∪ ∂a s
+  void pderive(const T &x, letter_id_t i, rex_ptr_set_t<T> &ps) const
   {
-    for (auto p : items_)
-      p->traverse(f);
+    for (const auto &r : items_)
+      r->pderivative(x, i, ps);
   };
 
-  const rex_ptr_set_t<T> items() const { return items_; }
-
 private:
   rex_ptr_set_t<T> items_;
+
+  // the items of equal sets may be iterated in different orders thus
+  // their hashes are mixed and summed
+  void init()
+  {
+    size_t sum = 0;
+    for (auto ptr : items_)
+      sum += ptr->hash() * 0x9e3779b97f4a7c15;
+    hash_combine(this->hash_, 0x426a3d31, sum);
+    this->nullable_ = std::any_of(std::begin(items_), std::end(items_), [](rex_ptr_t<T> r) { return r->nullable(); });
+    this->cache(items_);
+  };
 };
 
 //! And: r & s & t ...
@@ -266,22 +441,33 @@ public:
   //! And: r & s & t
   /*! the following simplification rules are implemented:
    *
-   * -     ∅ & r ≈ ∅
-   * -     r & ∅ ≈ ∅
-   * -     r & r ≈ r
-   * -     r & s ≈ s & r
-   * - r & s & t ≈ (r & s) & t
-   *             ≈  r & (s & t)
+   * -       ∅ & r ≈ ∅
+   * -       r & ∅ ≈ ∅
+   * -       r & r ≈ r
+   * -       r & s ≈ s & r
+   * -   r & s & t ≈ (r & s) & t
+   *               ≈  r & (s & t)
+   * - r & (r + s) ≈ r
+   * -       ε & r ≈ ν(r)
+   * -       r & s ≈ ν(r) & ν(s)  (no common letter)
    */
   static rex_ptr_t<T> make(rex_ptr_t<T> r, rex_ptr_t<T> s);
 
+  //! Intersection of a set of terms (simplified as above)
+  static rex_ptr_t<T> make(const rex_ptr_set_t<T> &ts);
+
   And(rex_ptr_t<T> r, rex_ptr_t<T> s)
-      : items_{r, s} {};
+      : items_{r, s}
+  {
+    init();
+  };
 
   And(const rex_ptr_set_t<T> &items)
-      : items_{items} {
-            // TBD: check size
-        };
+      : items_{items}
+  {
+    // TBD: check size
+    init();
+  };
 
   rex_t type() const { return Type; };
 
@@ -308,47 +494,69 @@ public:
     return true;
   };
 
-  size_t hash() const
+  void traverse(std::function<void(const T &)> f) const
   {
-    size_t seed = 0;
-    for (auto ptr : items_)
-      hash_combine(seed, 0x1ab34de1, ptr->hash());
-    return seed;
+    for (auto p : items_)
+      p->traverse(f);
   };
 
-  bool nullable() const
-  {
-    return std::all_of(std::begin(items_), std::end(items_), [](rex_ptr_t<T> r) { return r->nullable(); });
-  };
+  const rex_ptr_set_t<T> items() const { return items_; }
 
+protected:
   // ∂a (r & s) ≡ ∂a r & ∂a s
-  rex_ptr_t<T> derivative(const T &x) const
+  rex_ptr_t<T> derive(const T &x, letter_id_t i) const
   {
     rex_ptr_set_t<T> ds;
     for (auto r : items_)
     {
-      rex_ptr_t<T> d = r->derivative(x);
+      rex_ptr_t<T> d = r->derivative(x, i);
       if (d->type() == Zer<T>::Type)
         return d;
       ds.insert(d);
     }
-    if (ds.empty())
-      return Zer<T>::Instance;
-    if (ds.size() == 1)
-      return *ds.begin();
-    return std::make_shared<And>(ds);
+    return make(ds);
   };
 
-  void traverse(std::function<void(const T &)> f) const
+  // ∂a (r & s) ≡ { p & q | p ∈ ∂a r, q ∈ ∂a s }
+  void pderive(const T &x, letter_id_t i, rex_ptr_set_t<T> &ps) const
   {
-    for (auto p : items_)
-      p->traverse(f);
+    rex_ptr_set_t<T> acc;
+    bool             first = true;
+    for (const auto &r : items_)
+    {
+      rex_ptr_set_t<T> rs;
+      r->pderivative(x, i, rs);
+      if (rs.empty()) return;
+      if (first)
+      {
+        acc   = rs;
+        first = false;
+        continue;
+      }
+      rex_ptr_set_t<T> next;
+      for (const auto &p : acc)
+        for (const auto &q : rs)
+          Sum<T>::insert(make(p, q), next);
+      if (next.empty()) return;
+      acc.swap(next);
+    }
+    ps.insert(acc.begin(), acc.end());
   };
 
-  const rex_ptr_set_t<T> items() const { return items_; }
-
 private:
   rex_ptr_set_t<T> items_;
+
+  // the items of equal sets may be iterated in different orders thus
+  // their hashes are mixed and summed
+  void init()
+  {
+    size_t sum = 0;
+    for (auto ptr : items_)
+      sum += ptr->hash() * 0x9e3779b97f4a7c15;
+    hash_combine(this->hash_, 0x1ab34de1, sum);
+    this->nullable_ = std::all_of(std::begin(items_), std::end(items_), [](rex_ptr_t<T> r) { return r->nullable(); });
+    this->cache(items_);
+  };
 };
 
 //! Product: r · s · t ...
@@ -368,22 +576,26 @@ public:
    * - r · s · t ≈ (r · s) · t
    *             ≈  r · (s · t)
    * -  r* · r*  ≈ r*
+   * -  r  · r*  ≈ r* · r ≈ r+
+   * -  r+ · r*  ≈ r* · r+ ≈ r+
    *
-   * also products are put in normal form:
-   *
-   * - (r + s) · (x + y) ≈ r·x + s·x + r·y + s·y
-   * - (r + s) ·  x      ≈ r·x + s·x
-   * -      r  · (x + y) ≈ r·x + r·y
+   * sums are not distributed over products, the common prefixes of
+   * sums are factored instead (see Sum::make).
    */
   static rex_ptr_t<T> make(rex_ptr_t<T> r, rex_ptr_t<T> s);
 
   Prd(rex_ptr_t<T> r, rex_ptr_t<T> s)
-      : items_{r, s} {};
+      : items_{r, s}
+  {
+    init();
+  };
 
   Prd(const rex_ptr_vec_t<T> &items)
-      : items_{items} {
-            // TBD: check size
-        };
+      : items_{items}
+  {
+    // TBD: check size
+    init();
+  };
 
   rex_t type() const { return Type; };
 
@@ -410,41 +622,50 @@ public:
     return true;
   };
 
-  size_t hash() const
+  void traverse(std::function<void(const T &)> f) const
   {
-    size_t seed = 0;
-    for (auto ptr : items_)
-      hash_combine(seed, 0x12b9b0a1, ptr->hash());
-    return seed;
+    for (auto p : items_)
+      p->traverse(f);
   };
 
-  bool nullable() const
-  {
-    return std::all_of(std::begin(items_), std::end(items_), [](rex_ptr_t<T> r) { return r->nullable(); });
-  };
+  const rex_ptr_vec_t<T> items() const { return items_; }
 
+protected:
   // ∂a (r · s) ≡ ∂a r · s + ν(r) · ∂a s
-  rex_ptr_t<T> derivative(const T &x) const
+  rex_ptr_t<T> derive(const T &x, letter_id_t i) const
   {
     rex_ptr_t<T> r = head();
     rex_ptr_t<T> s = tail();
     if (r->nullable())
-      return Sum<T>::make(Prd<T>::make(r->derivative(x), s), s->derivative(x));
+      return Sum<T>::make(Prd<T>::make(r->derivative(x, i), s), s->derivative(x, i));
     else
-      return Prd<T>::make(r->derivative(x), s);
+      return Prd<T>::make(r->derivative(x, i), s);
   };
 
-  void traverse(std::function<void(const T &)> f) const
+  // ∂a (r · s) ≡ ∂a r · s ∪ ν(r) · ∂a s
+  void pderive(const T &x, letter_id_t i, rex_ptr_set_t<T> &ps) const
   {
-    for (auto p : items_)
-      p->traverse(f);
+    rex_ptr_t<T>     r = head();
+    rex_ptr_t<T>     s = tail();
+    rex_ptr_set_t<T> rs;
+    r->pderivative(x, i, rs);
+    for (const auto &p : rs)
+      Sum<T>::insert(Prd<T>::make(p, s), ps);
+    if (r->nullable())
+      s->pderivative(x, i, ps);
   };
 
-  const rex_ptr_vec_t<T> items() const { return items_; }
-
 private:
   rex_ptr_vec_t<T> items_;
 
+  void init()
+  {
+    for (auto ptr : items_)
+      hash_combine(this->hash_, 0x12b9b0a1, ptr->hash());
+    this->nullable_ = std::all_of(std::begin(items_), std::end(items_), [](rex_ptr_t<T> r) { return r->nullable(); });
+    this->cache(items_);
+  };
+
   rex_ptr_t<T> head() const { return items_[0]; };
   rex_ptr_t<T> tail() const
   {
@@ -467,13 +688,20 @@ public:
   /*! the following simplification rules are implemented:
    *
    * -     (r*)* ≈ r*
+   * -     (r+)* ≈ r*
+   * - (r + ε)*  ≈ r*
    * -        ε* ≈ ε
    * -        ∅* ≈ ε
    */
   static rex_ptr_t<T> make(rex_ptr_t<T> r);
 
   Kst(rex_ptr_t<T> r)
-      : item_{r} {};
+      : item_{r}
+  {
+    hash_combine(this->hash_, 0x2439ab37, item_->hash());
+    this->nullable_ = true;
+    this->cache(std::vector<rex_ptr_t<T>>{item_});
+  };
 
   rex_t type() const { return Type; };
 
@@ -491,25 +719,93 @@ public:
     return item_->equal(std::static_pointer_cast<const Kst>(r)->item());
   };
 
-  size_t hash() const
+  void traverse(std::function<void(const T &)> f) const { item_->traverse(f); };
+
+  const rex_ptr_t<T> item() const { return item_; };
+
+protected:
+  // ∂a (r*) ≡ ∂a r · (r*)
+  rex_ptr_t<T> derive(const T &x, letter_id_t i) const
   {
-    size_t seed = 0;
-    hash_combine(seed, 0x2439ab37, item_->hash());
-    return seed;
+    return Prd<T>::make(item_->derivative(x, i), make(item_));
   };
 
-  bool nullable() const { return true; };
-
   // ∂a (r*) ≡ ∂a r · (r*)
-  rex_ptr_t<T> derivative(const T &x) const
+  void pderive(const T &x, letter_id_t i, rex_ptr_set_t<T> &ps) const
   {
-    return Prd<T>::make(item_->derivative(x), make(item_));
+    rex_ptr_set_t<T> rs;
+    item_->pderivative(x, i, rs);
+    rex_ptr_t<T> k = make(item_);
+    for (const auto &p : rs)
+      Sum<T>::insert(Prd<T>::make(p, k), ps);
+  };
+
+private:
+  rex_ptr_t<T> item_;
+};
+
+//! Kleene Plus: r+ (r · r*)
+template <typename T>
+class Pls : public Rex<T>
+{
+public:
+  static const rex_t Type = 8;
+
+  //! Kleene Plus: r+
+  /*! the following simplification rules are implemented:
+   *
+   * -     (r+)+ ≈ r+
+   * -     (r*)+ ≈ r*
+   * -        r+ ≈ r*  (r nullable)
+   * -        ∅+ ≈ ∅
+   */
+  static rex_ptr_t<T> make(rex_ptr_t<T> r);
+
+  Pls(rex_ptr_t<T> r)
+      : item_{r}
+  {
+    hash_combine(this->hash_, 0x5b1d73c9, item_->hash());
+    this->nullable_ = item_->nullable();
+    this->cache(std::vector<rex_ptr_t<T>>{item_});
+  };
+
+  rex_t type() const { return Type; };
+
+  void print(std::ostream &os) const
+  {
+    os << "(";
+    item_->print(os);
+    os << ")+";
+  };
+
+  bool equal(rex_ptr_t<T> r) const
+  {
+    if (r->type() != Type)
+      return false;
+    return item_->equal(std::static_pointer_cast<const Pls>(r)->item());
   };
 
   void traverse(std::function<void(const T &)> f) const { item_->traverse(f); };
 
   const rex_ptr_t<T> item() const { return item_; };
 
+protected:
+  // ∂a (r+) ≡ ∂a r · (r*)
+  rex_ptr_t<T> derive(const T &x, letter_id_t i) const
+  {
+    return Prd<T>::make(item_->derivative(x, i), Kst<T>::make(item_));
+  };
+
+  // ∂a (r+) ≡ ∂a r · (r*)
+  void pderive(const T &x, letter_id_t i, rex_ptr_set_t<T> &ps) const
+  {
+    rex_ptr_set_t<T> rs;
+    item_->pderivative(x, i, rs);
+    rex_ptr_t<T> k = Kst<T>::make(item_);
+    for (const auto &p : rs)
+      Sum<T>::insert(Prd<T>::make(p, k), ps);
+  };
+
 private:
   rex_ptr_t<T> item_;
 };
@@ -578,6 +874,13 @@ rex_ptr_t<T> map(rex_ptr_t<S> r)
     break;
   }
 
+  case Pls<S>::Type:
+  {
+    rex_ptr_t<S> item = std::static_pointer_cast<Pls<S>>(r)->item();
+    return std::make_shared<Pls<T>>(Pls<T>{map<S, T>(item)});
+    break;
+  }
+
   default:
     break;
   }
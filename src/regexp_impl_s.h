@@ -3,6 +3,50 @@
 namespace regexp_impl
 {
 
+//! Largest sum whose terms are factored
+/*! Factoring groups the terms of a sum by their first factor, it is
+ *  linear in the number of terms but it is tried on each sum built thus
+ *  bigger sums are left as they are.
+ */
+const size_t FACTOR_TERMS = 64;
+
+//! First factor and rest of a product (r ≈ r · ε)
+template <typename T>
+std::pair<rex_ptr_t<T>, rex_ptr_t<T>> split_head(rex_ptr_t<T> r)
+{
+  if (r->type() != Prd<T>::Type) return {r, One<T>::Instance};
+  rex_ptr_vec_t<T> rs = std::static_pointer_cast<const Prd<T>>(r)->items();
+  if (rs.size() == 2) return {rs[0], rs[1]};
+  return {rs[0], std::make_shared<Prd<T>>(rex_ptr_vec_t<T>{rs.begin() + 1, rs.end()})};
+};
+
+//! Factor the terms of a sum sharing their first factor
+/*! a·r + a·s ≈ a·(r + s), the terms are left untouched when no factor
+ *  is shared. Common suffixes are not factored: derivatives consume
+ *  the prefixes and (r + s)·a is split again as ∂r·a + ∂s·a, mixing
+ *  both forms yields more distinct states.
+ */
+template <typename T>
+void factor(rex_ptr_set_t<T> &ts)
+{
+  using group_t = std::unordered_map<rex_ptr_t<T>, rex_ptr_set_t<T>, rex_ptr_hash<T>, rex_ptr_eq<T>>;
+
+  group_t groups;
+  for (const auto &t : ts)
+  {
+    auto f = split_head<T>(t);
+    groups[f.first].insert(f.second);
+  }
+  if (groups.size() == ts.size()) return;
+
+  ts.clear();
+  for (const auto &g : groups)
+  {
+    rex_ptr_t<T> rest = g.second.size() == 1 ? *g.second.begin() : Sum<T>::make(g.second);
+    Sum<T>::insert(Prd<T>::make(g.first, rest), ts);
+  }
+};
+
 template <typename T>
 rex_ptr_t<T> Sum<T>::make(rex_ptr_t<T> r, rex_ptr_t<T> s)
 {
@@ -12,67 +56,149 @@ rex_ptr_t<T> Sum<T>::make(rex_ptr_t<T> r, rex_ptr_t<T> s)
   if (s->type() == Zer<T>::Type) return r;
   // r + r ≈ r
   if (r->equal(s)) return r;
-  // (r + s) + t ≈ r + s + t
-  if (r->type() == Type)
+  // (r + s) + (t + u) ≈ r + s + t + u
+  rex_ptr_set_t<T> ts;
+  insert(r, ts);
+  insert(s, ts);
+  return make(ts);
+};
+
+template <typename T>
+rex_ptr_t<T> Sum<T>::make(const rex_ptr_set_t<T> &items)
+{
+  rex_ptr_set_t<T> ts;
+  for (const auto &t : items)
+    insert(t, ts);
+
+  // ε + r+ ≈ r*, ε + r ≈ r (r nullable)
+  if (ts.size() > 1 && ts.count(One<T>::Instance))
   {
-    rex_ptr_set_t<T> ts;
-    rex_ptr_set_t<T> rs = std::static_pointer_cast<const Sum>(r)->items();
-    ts.insert(rs.begin(), rs.end());
-    if (s->type() == Sum<T>::Type)
+    auto p = std::find_if(ts.begin(), ts.end(), [](const rex_ptr_t<T> &t) { return t->type() == Pls<T>::Type; });
+    if (p != ts.end())
     {
-      rex_ptr_set_t<T> ss = std::static_pointer_cast<const Sum>(s)->items();
-      ts.insert(ss.begin(), ss.end());
+      rex_ptr_t<T> k = Kst<T>::make(std::static_pointer_cast<const Pls<T>>(*p)->item());
+      ts.erase(p);
+      ts.insert(k);
     }
-    else
-      ts.insert(s);
-    return std::make_shared<Sum>(ts);
+    if (std::any_of(ts.begin(), ts.end(), [](const rex_ptr_t<T> &t) { return t->type() != One<T>::Type && t->nullable(); }))
+      ts.erase(One<T>::Instance);
   }
-  // r + (s + t) ≈ r + s + t
-  if (s->type() == Type)
+
+  // r + (r & s) ≈ r
+  for (auto it = ts.begin(); it != ts.end();)
   {
-    rex_ptr_set_t<T> ts;
-    rex_ptr_set_t<T> ss = std::static_pointer_cast<const Sum>(s)->items();
-    ts.insert(ss.begin(), ss.end());
-    ts.insert(r);
-    return std::make_shared<Sum>(ts);
+    bool absorbed = false;
+    if ((*it)->type() == And<T>::Type)
+      for (const auto &a : std::static_pointer_cast<const And<T>>(*it)->items())
+        if (ts.count(a))
+        {
+          absorbed = true;
+          break;
+        }
+    it = absorbed ? ts.erase(it) : std::next(it);
   }
-  return std::make_shared<Sum>(r, s);
+
+  // a·r + a·s ≈ a·(r + s)
+  if (ts.size() > 1 && ts.size() <= FACTOR_TERMS)
+    factor<T>(ts);
+
+  if (ts.empty()) return Zer<T>::Instance;
+  if (ts.size() == 1) return *ts.begin();
+  return std::make_shared<Sum>(ts);
 };
 
 template <typename T>
 rex_ptr_t<T> And<T>::make(rex_ptr_t<T> r, rex_ptr_t<T> s)
 {
-  // ∅ & s ≈ s
+  // ∅ & s ≈ ∅
   if (r->type() == Zer<T>::Type) return r;
-  // r & ∅ ≈ r
+  // r & ∅ ≈ ∅
   if (s->type() == Zer<T>::Type) return s;
   // r & r ≈ r
   if (r->equal(s)) return r;
-  // (r & s) & t ≈ r & s & t
-  if (r->type() == And::Type)
-  {
-    rex_ptr_set_t<T> ts;
-    rex_ptr_set_t<T> rs = std::static_pointer_cast<const And>(r)->items();
-    ts.insert(rs.begin(), rs.end());
-    if (s->type() == And::Type)
+  // (r & s) & (t & u) ≈ r & s & t & u
+  rex_ptr_set_t<T> ts;
+  for (const auto &t : {r, s})
+    if (t->type() == Type)
     {
-      rex_ptr_set_t<T> ss = std::static_pointer_cast<const And>(s)->items();
-      ts.insert(ss.begin(), ss.end());
+      rex_ptr_set_t<T> items = std::static_pointer_cast<const And>(t)->items();
+      ts.insert(items.begin(), items.end());
     }
     else
-      ts.insert(s);
-    return std::make_shared<And>(ts);
+      ts.insert(t);
+  return make(ts);
+};
+
+template <typename T>
+rex_ptr_t<T> And<T>::make(const rex_ptr_set_t<T> &items)
+{
+  rex_ptr_set_t<T> ts;
+  for (const auto &t : items)
+  {
+    // ∅ & r ≈ ∅
+    if (t->type() == Zer<T>::Type) return t;
+    ts.insert(t);
   }
-  // r & (s & t) ≈ r & s & t
-  if (s->type() == And::Type)
+  if (ts.empty()) return Zer<T>::Instance;
+
+  // ε & r ≈ ν(r), r & s ≈ ν(r) & ν(s) (no common letter)
+  bool disjoint = ts.count(One<T>::Instance) > 0;
+  for (auto it = ts.begin(); !disjoint && it != ts.end(); ++it)
+    for (auto jt = std::next(it); !disjoint && jt != ts.end(); ++jt)
+      disjoint = !(*it)->letters().intersects((*jt)->letters());
+  if (disjoint)
   {
-    rex_ptr_set_t<T> ts;
-    rex_ptr_set_t<T> ss = std::static_pointer_cast<const And>(s)->items();
-    ts.insert(ss.begin(), ss.end());
-    ts.insert(r);
-    return std::make_shared<And>(ts);
+    bool nullable = std::all_of(ts.begin(), ts.end(), [](const rex_ptr_t<T> &t) { return t->nullable(); });
+    return nullable ? One<T>::Instance : Zer<T>::Instance;
   }
-  return std::make_shared<And>(r, s);
+
+  // r & (r + s) ≈ r
+  for (auto it = ts.begin(); it != ts.end();)
+  {
+    bool absorbed = false;
+    if ((*it)->type() == Sum<T>::Type)
+      for (const auto &t : std::static_pointer_cast<const Sum<T>>(*it)->items())
+        if (ts.count(t))
+        {
+          absorbed = true;
+          break;
+        }
+    it = absorbed ? ts.erase(it) : std::next(it);
+  }
+
+  if (ts.size() == 1) return *ts.begin();
+  return std::make_shared<And>(ts);
+};
+
+//! Product of two adjacent factors when it simplifies to one factor
+/*! r* · r* ≈ r*, r · r* ≈ r* · r ≈ r+, r+ · r* ≈ r* · r+ ≈ r+ otherwise
+ *  nullptr
+ */
+template <typename T>
+rex_ptr_t<T> join(rex_ptr_t<T> r, rex_ptr_t<T> s)
+{
+  auto item = [](rex_ptr_t<T> t) -> rex_ptr_t<T> {
+    if (t->type() == Kst<T>::Type) return std::static_pointer_cast<const Kst<T>>(t)->item();
+    if (t->type() == Pls<T>::Type) return std::static_pointer_cast<const Pls<T>>(t)->item();
+    return nullptr;
+  };
+  rex_ptr_t<T> ri = item(r);
+  rex_ptr_t<T> si = item(s);
+  if (s->type() == Kst<T>::Type)
+  {
+    // r* · r* ≈ r*, r+ · r* ≈ r+
+    if (ri && ri->equal(si)) return r;
+    // r · r* ≈ r+
+    if (r->equal(si)) return Pls<T>::make(si);
+  }
+  if (r->type() == Kst<T>::Type)
+  {
+    // r* · r+ ≈ r+
+    if (si && s->type() == Pls<T>::Type && si->equal(ri)) return s;
+    // r* · r ≈ r+
+    if (s->equal(ri)) return Pls<T>::make(ri);
+  }
+  return nullptr;
 };
 
 template <typename T>
@@ -82,78 +208,28 @@ rex_ptr_t<T> Prd<T>::make(rex_ptr_t<T> r, rex_ptr_t<T> s)
   if (r->type() == Zer<T>::Type || s->type() == One<T>::Type) return r;
   // r · ∅ ≈ ∅, ε · s ≈ s
   if (s->type() == Zer<T>::Type || r->type() == One<T>::Type) return s;
-  // r* · r* ≈ r*
-  if (r->type() == Kst<T>::Type && s->type() == Kst<T>::Type)
-  {
-    rex_ptr_t<T> ri = std::static_pointer_cast<const Kst<T>>(r)->item();
-    rex_ptr_t<T> si = std::static_pointer_cast<const Kst<T>>(s)->item();
-    if (ri->equal(si)) return r;
-  }
-  // (r + s) · (x + y) ≈ r·x + s·x + r·y + s·y
-  // if (r->type() == Sum<T>::Type && s->type() == Sum<T>::Type)
-  // {
-  //   rex_ptr_set_t<T> rs = std::static_pointer_cast<const Sum<T>>(r)->items();
-  //   rex_ptr_set_t<T> ss = std::static_pointer_cast<const Sum<T>>(s)->items();
-  //   rex_ptr_set_t<T> ts;
-  //   for (auto r_t : rs)
-  //     for (auto s_t : ss)
-  //       ts.insert(Prd<T>::make(r_t, s_t));
-  //   return std::accumulate(
-  //       ts.begin(),
-  //       ts.end(),
-  //       Zer<T>::Instance,
-  //       [](const rex_ptr_t<T> &a, const rex_ptr_t<T> &b) { return Sum<T>::make(a, b); });
-  // }
-  // (r + s) · x ≈ r·x + s·x
-  // if (r->type() == Sum<T>::Type)
-  // {
-  //   rex_ptr_set_t<T> ts;
-  //   for (auto t : std::static_pointer_cast<const Sum<T>>(r)->items())
-  //     ts.insert(Prd<T>::make(t, s));
-  //   return std::accumulate(
-  //       ts.begin(),
-  //       ts.end(),
-  //       Zer<T>::Instance,
-  //       [](const rex_ptr_t<T> &a, const rex_ptr_t<T> &b) { return Sum<T>::make(a, b); });
-  // }
-  // r · (x + y) ≈ r·x + r·y
-  // if (s->type() == Sum<T>::Type)
-  // {
-  //   rex_ptr_set_t<T> ts;
-  //   for (auto t : std::static_pointer_cast<const Sum<T>>(s)->items())
-  //     ts.insert(Prd<T>::make(r, t));
-  //   return std::accumulate(
-  //       ts.begin(),
-  //       ts.end(),
-  //       Zer<T>::Instance,
-  //       [](const rex_ptr_t<T> &a, const rex_ptr_t<T> &b) { return Sum<T>::make(a, b); });
-  // }
-  // (r · s) · t ≈ r · s · t
-  if (r->type() == Prd<T>::Type)
-  {
-    rex_ptr_vec_t<T> ts;
-    rex_ptr_vec_t<T> rs = std::static_pointer_cast<const Prd<T>>(r)->items();
-    ts.insert(ts.end(), rs.begin(), rs.end());
-    if (s->type() == Prd::Type)
+  // (r · s) · (t · u) ≈ r · s · t · u
+  rex_ptr_vec_t<T> ts;
+  for (const auto &t : {r, s})
+    if (t->type() == Type)
     {
-      rex_ptr_vec_t<T> ss =
-          std::static_pointer_cast<const Prd<T>>(s)->items();
-      ts.insert(ts.end(), ss.begin(), ss.end());
+      rex_ptr_vec_t<T> items = std::static_pointer_cast<const Prd<T>>(t)->items();
+      ts.insert(ts.end(), items.begin(), items.end());
     }
     else
-      ts.push_back(s);
-    return std::make_shared<Prd<T>>(ts);
-  }
-  // r · (s · t) ≈ r · s · t
-  if (s->type() == Prd<T>::Type)
+      ts.push_back(t);
+  // r · r* ≈ r+, ... at the junction of the two products (and then
+  // leftwards as long as the joined factor simplifies)
+  size_t k = r->type() == Type ? std::static_pointer_cast<const Prd<T>>(r)->items().size() : 1;
+  for (; k > 0 && k < ts.size(); k--)
   {
-    rex_ptr_vec_t<T> ts;
-    ts.push_back(r);
-    rex_ptr_vec_t<T> ss = std::static_pointer_cast<const Prd<T>>(s)->items();
-    ts.insert(ts.end(), ss.begin(), ss.end());
-    return std::make_shared<Prd<T>>(ts);
+    rex_ptr_t<T> j = join<T>(ts[k - 1], ts[k]);
+    if (!j) break;
+    ts[k - 1] = j;
+    ts.erase(ts.begin() + k);
   }
-  return std::make_shared<Prd<T>>(r, s);
+  if (ts.size() == 1) return ts[0];
+  return std::make_shared<Prd<T>>(ts);
 };
 
 template <typename T>
@@ -163,6 +239,26 @@ rex_ptr_t<T> Kst<T>::make(rex_ptr_t<T> r)
   if (r->type() == One<T>::Type || r->type() == Zer<T>::Type) return One<T>::Instance;
   // r** ≈ r*
   if (r->type() == Type) return r;
+  // (r+)* ≈ r*
+  if (r->type() == Pls<T>::Type) return make(std::static_pointer_cast<const Pls<T>>(r)->item());
+  // (r + ε)* ≈ r*
+  if (r->type() == Sum<T>::Type)
+  {
+    rex_ptr_set_t<T> ts = std::static_pointer_cast<const Sum<T>>(r)->items();
+    if (ts.erase(One<T>::Instance)) return make(Sum<T>::make(ts));
+  }
   return std::make_shared<Kst>(r);
 };
+
+template <typename T>
+rex_ptr_t<T> Pls<T>::make(rex_ptr_t<T> r)
+{
+  // ∅+ ≈ ∅
+  if (r->type() == Zer<T>::Type) return r;
+  // r+ ≈ r* (r nullable, ε+ ≈ ε, (r*)+ ≈ r*)
+  if (r->nullable()) return Kst<T>::make(r);
+  // (r+)+ ≈ r+
+  if (r->type() == Type) return r;
+  return std::make_shared<Pls>(r);
+};
 }
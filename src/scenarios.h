@@ -0,0 +1,62 @@
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+#include "plan.h"
+
+namespace scenarios
+{
+  //! Staffing energy of a plan week against each demand scenario
+  /*! The scenarios are perturbed target curves in 5 minutes slots (as
+   *  the plan target), the energy of each scenario is the weighted
+   *  staffing energy over the week
+   *
+   *  E_s = Sum_i w_i (d_si - staffing_i)^2 / n
+   *
+   *  The scenarios are split in contiguous blocks scored in parallel,
+   *  the inner loop over the slots is a plain reduction on contiguous
+   *  arrays so that it can be vectorized.
+   */
+  inline std::vector<double> energies(const plan::Plan &plan, unsigned int week, const std::vector<std::vector<double>> &scenarios)
+  {
+    const size_t slot0 = static_cast<size_t>(week) * 7 * SLOTS_DAY;
+    const size_t n     = plan.weekSlots();
+    if (slot0 + n > plan.staffing_.size()) throw std::invalid_argument{"week exceed plan length"};
+    for (const auto &d : scenarios)
+      if (d.size() < slot0 + n) throw std::invalid_argument{"scenario shorter than the plan"};
+
+    std::vector<double> e(scenarios.size(), 0.0);
+
+    const double *w     = plan.weights_.data() + slot0;
+    const double *x     = plan.staffing_.data() + slot0;
+    auto          score = [&](size_t s0, size_t s1) {
+      for (size_t s = s0; s < s1; s++)
+        {
+          const double *d   = scenarios[s].data() + slot0;
+          double        acc = 0.0;
+#pragma omp simd reduction(+ : acc)
+          for (size_t i = 0; i < n; i++)
+            {
+              double r = d[i] - x[i];
+              acc += w[i] * r * r;
+            }
+          e[s] = acc / n;
+        }
+    };
+
+    const size_t             threads = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), scenarios.size()));
+    const size_t             block   = (scenarios.size() + threads - 1) / threads;
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; t++)
+      workers.emplace_back(score, std::min(t * block, scenarios.size()), std::min((t + 1) * block, scenarios.size()));
+    score(0, std::min(block, scenarios.size()));
+    for (auto &worker : workers)
+      worker.join();
+
+    return e;
+  };
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+#include "plan.h"
+#include "shift.h"
+#include "staff_energy.h"
+#include "target.h"
+
+namespace scoring
+{
+  //! Energies of a scored plan
+  struct score_t
+  {
+    double              staffing_energy;
+    double              comfort_energy;
+    std::vector<double> day_energies;
+  };
+
+  //! Score plans built elsewhere with the planner energies
+  /*! Each plan is a matrix of shift indices (one row per agent, one
+   *  column per target day), the staffing and comfort energies of the
+   *  week are those of the planner and the day energies are computed
+   *  over every day of the target. Flexible breaks keep their default
+   *  placement.
+   *
+   *  Plans are independent and scored in parallel (each one on a single
+   *  thread), the slot offset is found from the shifts ending after
+   *  midnight.
+   */
+  inline std::vector<score_t> score(const target::Target &target, const std::vector<shift::Shift> &shifts, const std::vector<std::vector<std::vector<int>>> &plans, unsigned int week)
+  {
+    if (shifts.empty()) throw std::invalid_argument{"you must provide some shifts"};
+    if ((week + 1) * 7 > target.days()) throw std::invalid_argument{"week exceed plan length"};
+
+    for (const auto &pln : plans)
+      {
+        if (pln.empty()) throw std::invalid_argument{"you must add agents to create a plan"};
+        for (const auto &line : pln)
+          {
+            if (line.size() != target.days()) throw std::invalid_argument{"agent line length must match the target days"};
+            for (int s : line)
+              if (s < 0 || static_cast<size_t>(s) >= shifts.size()) throw std::invalid_argument{"shift index out of range"};
+          }
+      }
+
+    unsigned int offset = 0;
+    for (const auto &sht : shifts)
+      if (sht.work() && sht.t1() > 24 * 60) offset = std::max(offset, sht.t1() - 24 * 60);
+
+    std::vector<score_t> scores(plans.size());
+
+    std::atomic<size_t> next{0};
+    auto                worker = [&]() {
+      for (size_t k = next++; k < plans.size(); k = next++)
+        {
+          std::vector<std::string> agents(plans[k].size());
+          for (size_t a = 0; a < agents.size(); a++)
+            agents[a] = std::to_string(a);
+
+          plan::Plan plan{offset, agents, target};
+          for (size_t a = 0; a < agents.size(); a++)
+            for (unsigned int day = 0; day < target.days(); day++)
+              plan.plan_[a][day] = shifts[plans[k][a][day]];
+          plan.staffing_ = plan.computeStaffing(1);
+
+          scores[k].staffing_energy = staff_planner::staffing_energy{plan, week}.energy();
+          scores[k].comfort_energy  = staff_planner::comfort_energy{plan, week}.energy();
+          for (unsigned int day = 0; day < target.days(); day++)
+            scores[k].day_energies.push_back(plan.energy(day));
+        }
+    };
+
+    const size_t             threads = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), plans.size()));
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; t++)
+      workers.emplace_back(worker);
+    worker();
+    for (auto &w : workers)
+      w.join();
+
+    return scores;
+  };
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace segment_tree
+{
+  //! Segment tree over a vector of values
+  /*! The tree supports the following operations:
+   *
+   *  - add a constant to a range of values in O(log n)
+   *  - minimum/maximum of a range of values in O(log n)
+   *  - count the values below a threshold in a range in O(k log n)
+   *    where k is the number of values found
+   *
+   *  Range additions are stored as tags on the covering nodes and are
+   *  never pushed down to the children, this way every query can be
+   *  performed on a const tree by accumulating the tags along the
+   *  path.
+   */
+  class SegmentTree
+  {
+  public:
+    SegmentTree()
+      : size_{0}
+      , min_{}
+      , max_{}
+      , tag_{} {};
+
+    //! Build the tree over the values
+    SegmentTree(const std::vector<double> &values)
+      : size_{static_cast<unsigned int>(values.size())}
+      , min_(4 * std::max<size_t>(values.size(), 1), 0.0)
+      , max_(4 * std::max<size_t>(values.size(), 1), 0.0)
+      , tag_(4 * std::max<size_t>(values.size(), 1), 0.0)
+    {
+      if (size_ > 0) build(1, 0, size_, values);
+    };
+
+    //! Number of values
+    unsigned int size() const
+    {
+      return size_;
+    };
+
+    //! Add c to the values in [i0, i1)
+    void add(unsigned int i0, unsigned int i1, double c)
+    {
+      if (i1 > size_) i1 = size_;
+      if (i0 >= i1 || c == 0.0) return;
+      add(1, 0, size_, i0, i1, c);
+    };
+
+    //! Minimum value in [i0, i1)
+    double min(unsigned int i0, unsigned int i1) const
+    {
+      if (i1 > size_) i1 = size_;
+      if (i0 >= i1) return std::numeric_limits<double>::infinity();
+      return min(1, 0, size_, i0, i1, 0.0);
+    };
+
+    //! Maximum value in [i0, i1)
+    double max(unsigned int i0, unsigned int i1) const
+    {
+      if (i1 > size_) i1 = size_;
+      if (i0 >= i1) return -std::numeric_limits<double>::infinity();
+      return max(1, 0, size_, i0, i1, 0.0);
+    };
+
+    //! Number of values strictly below thr in [i0, i1)
+    unsigned int count_below(unsigned int i0, unsigned int i1, double thr) const
+    {
+      if (i1 > size_) i1 = size_;
+      if (i0 >= i1) return 0;
+      return count_below(1, 0, size_, i0, i1, thr, 0.0);
+    };
+
+    //! Value at position i
+    double value(unsigned int i) const
+    {
+      if (i >= size_) throw std::out_of_range{"segment tree index out of range"};
+      return min(i, i + 1);
+    };
+
+  private:
+    unsigned int        size_;
+    std::vector<double> min_;
+    std::vector<double> max_;
+    std::vector<double> tag_;
+
+    void build(unsigned int n, unsigned int l, unsigned int r, const std::vector<double> &values)
+    {
+      if (r - l == 1)
+        {
+          min_[n] = max_[n] = values[l];
+          return;
+        }
+      unsigned int m = (l + r) / 2;
+      build(2 * n, l, m, values);
+      build(2 * n + 1, m, r, values);
+      min_[n] = std::min(min_[2 * n], min_[2 * n + 1]);
+      max_[n] = std::max(max_[2 * n], max_[2 * n + 1]);
+    };
+
+    void add(unsigned int n, unsigned int l, unsigned int r, unsigned int i0, unsigned int i1, double c)
+    {
+      if (i0 <= l && r <= i1)
+        {
+          tag_[n] += c;
+          min_[n] += c;
+          max_[n] += c;
+          return;
+        }
+      unsigned int m = (l + r) / 2;
+      if (i0 < m) add(2 * n, l, m, i0, i1, c);
+      if (i1 > m) add(2 * n + 1, m, r, i0, i1, c);
+      min_[n] = std::min(min_[2 * n], min_[2 * n + 1]) + tag_[n];
+      max_[n] = std::max(max_[2 * n], max_[2 * n + 1]) + tag_[n];
+    };
+
+    double min(unsigned int n, unsigned int l, unsigned int r, unsigned int i0, unsigned int i1, double acc) const
+    {
+      if (i0 <= l && r <= i1) return min_[n] + acc;
+      unsigned int m = (l + r) / 2;
+      double       v = std::numeric_limits<double>::infinity();
+      if (i0 < m) v = std::min(v, min(2 * n, l, m, i0, i1, acc + tag_[n]));
+      if (i1 > m) v = std::min(v, min(2 * n + 1, m, r, i0, i1, acc + tag_[n]));
+      return v;
+    };
+
+    double max(unsigned int n, unsigned int l, unsigned int r, unsigned int i0, unsigned int i1, double acc) const
+    {
+      if (i0 <= l && r <= i1) return max_[n] + acc;
+      unsigned int m = (l + r) / 2;
+      double       v = -std::numeric_limits<double>::infinity();
+      if (i0 < m) v = std::max(v, max(2 * n, l, m, i0, i1, acc + tag_[n]));
+      if (i1 > m) v = std::max(v, max(2 * n + 1, m, r, i0, i1, acc + tag_[n]));
+      return v;
+    };
+
+    unsigned int count_below(unsigned int n, unsigned int l, unsigned int r, unsigned int i0, unsigned int i1, double thr, double acc) const
+    {
+      if (min_[n] + acc >= thr) return 0;
+      if (i0 <= l && r <= i1 && max_[n] + acc < thr) return r - l;
+      if (r - l == 1) return 1;
+      unsigned int m = (l + r) / 2;
+      unsigned int c = 0;
+      if (i0 < m) c += count_below(2 * n, l, m, i0, i1, thr, acc + tag_[n]);
+      if (i1 > m) c += count_below(2 * n + 1, m, r, i0, i1, thr, acc + tag_[n]);
+      return c;
+    };
+  };
+}
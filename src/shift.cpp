@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <iostream>
+#include <limits>
 #include <string>
 #include <vector>
 
@@ -12,20 +13,41 @@ namespace shift
   Shift::Shift()
     : work_{false}
     , code_{}
-    , span_{} {};
+    , span_{}
+    , events_{}
+    , hours_{0.0}
+    , flags_{0}
+    , base_{}
+    , breaks_{}
+    , placed_{} {};
 
-  Shift::Shift(const std::string &code, const std::vector<span_t> &span)
+  Shift::Shift(const std::string &code, const std::vector<span_t> &span, unsigned int flags, const std::vector<break_t> &breaks)
     : work_{!span.empty()}
     , code_{code}
     , span_{span}
+    , events_{}
+    , hours_{0.0}
+    , flags_{flags}
+    , base_{}
+    , breaks_{breaks}
+    , placed_{}
   {
     std::sort(span_.begin(), span_.end(), [](const Shift::span_t &a, const Shift::span_t &b) { return a.first < b.first; });
+    set_breaks();
+    set_spans();
+    set_hours();
   };
 
-  Shift::Shift(const std::string &code, const std::vector<std::vector<int>> &span)
+  Shift::Shift(const std::string &code, const std::vector<std::vector<int>> &span, unsigned int flags, const std::vector<std::vector<int>> &breaks)
     : work_{!span.empty()}
     , code_{code}
     , span_{}
+    , events_{}
+    , hours_{0.0}
+    , flags_{flags}
+    , base_{}
+    , breaks_{}
+    , placed_{}
   {
     for (const auto &s : span) {
       if (s.size() != 2)
@@ -34,14 +56,27 @@ namespace shift
         throw std::invalid_argument("time cannot be negative");
       span_.push_back(std::make_pair((unsigned int)s[0], (unsigned int)s[1]));
     }
+    for (const auto &b : breaks) {
+      if (b.size() != 3)
+        throw std::invalid_argument("invalid break window");
+      if (b[0] < 0 || b[1] < 0 || b[2] <= 0)
+        throw std::invalid_argument("invalid break window");
+      breaks_.push_back({(unsigned int)b[0], (unsigned int)b[1], (unsigned int)b[2]});
+    }
     std::sort(span_.begin(), span_.end(), [](const Shift::span_t &a, const Shift::span_t &b) { return a.first < b.first; });
+    set_breaks();
+    set_spans();
+    set_hours();
   };
 
   bool Shift::operator==(const Shift &oth) const
   {
-    if (span_.empty() && oth.span_.empty()) return code_ == oth.code_;
-    if (span_.size() != oth.span_.size()) return false;
-    return std::equal(span_.begin(), span_.end(), oth.span_.begin());
+    if (base_.empty() && oth.base_.empty()) return code_ == oth.code_;
+    if (base_.size() != oth.base_.size() || breaks_.size() != oth.breaks_.size()) return false;
+    return std::equal(base_.begin(), base_.end(), oth.base_.begin()) &&
+           std::equal(breaks_.begin(), breaks_.end(), oth.breaks_.begin(), [](const break_t &a, const break_t &b) {
+             return a.t0 == b.t0 && a.t1 == b.t1 && a.length == b.length;
+           });
   };
   bool Shift::operator!=(const Shift &oth) const
   {
@@ -50,19 +85,19 @@ namespace shift
 
   bool Shift::operator<(const Shift &oth) const
   {
-    if (span_.empty() && oth.span_.empty()) return code_ < oth.code_;
-    if (!span_.empty() && oth.span_.empty()) return true;
-    if (span_.empty() && !oth.span_.empty()) return false;
+    if (base_.empty() && oth.base_.empty()) return code_ < oth.code_;
+    if (!base_.empty() && oth.base_.empty()) return true;
+    if (base_.empty() && !oth.base_.empty()) return false;
 
-    return span_.front().first < oth.span_.front().first;
+    return base_.front().first < oth.base_.front().first;
   };
   bool Shift::operator>(const Shift &oth) const
   {
-    if (span_.empty() && oth.span_.empty()) return code_ > oth.code_;
-    if (!span_.empty() && oth.span_.empty()) return false;
-    if (span_.empty() && !oth.span_.empty()) return true;
+    if (base_.empty() && oth.base_.empty()) return code_ > oth.code_;
+    if (!base_.empty() && oth.base_.empty()) return false;
+    if (base_.empty() && !oth.base_.empty()) return true;
 
-    return span_.front().first > oth.span_.front().first;
+    return base_.front().first > oth.base_.front().first;
   };
 
   bool Shift::operator<=(const Shift &oth) const { return *this == oth || *this < oth; };
@@ -80,32 +115,191 @@ namespace shift
 
   unsigned int Shift::t0() const
   {
-    return span_.empty() ? 0 : span_[0].first;
+    return base_.empty() ? 0 : base_[0].first;
   };
 
   unsigned int Shift::t1() const
   {
-    return span_.empty() ? 24 * 60 : span_.back().second;
+    return base_.empty() ? 24 * 60 : base_.back().second;
   };
 
   bool Shift::work() const { return work_; };
 
+  double Shift::hours() const { return hours_; };
+
+  unsigned int Shift::flags() const { return flags_; };
+
+  void Shift::set_hours()
+  {
+    unsigned int m = 0;
+    for (const auto &s : span_)
+      if (s.second > s.first) m += s.second - s.first;
+    hours_ = static_cast<double>(m) / 60;
+  };
+
   const std::string Shift::code() const { return code_; };
 
   const std::vector<Shift::span_t> Shift::span() const { return span_; };
 
-  void Shift::add_staff(unsigned int day, double c, std::vector<double> &stf) const
+  bool Shift::flexible() const { return !breaks_.empty(); };
+
+  const std::vector<Shift::span_t> Shift::breaks() const
+  {
+    std::vector<span_t> brk;
+    for (size_t i = 0; i < breaks_.size(); i++)
+      brk.push_back(std::make_pair(placed_[i], placed_[i] + breaks_[i].length));
+    return brk;
+  };
+
+  void Shift::set_breaks()
+  {
+    base_ = span_;
+    placed_.clear();
+    if (breaks_.empty()) return;
+
+    if (!work_)
+      throw std::invalid_argument("rest shifts cannot have breaks");
+
+    std::sort(breaks_.begin(), breaks_.end(), [](const break_t &a, const break_t &b) { return a.t0 < b.t0; });
+
+    unsigned int t = 0;
+    for (const auto &b : breaks_)
+      {
+        if (b.t0 % SLOT_LENGTH || b.t1 % SLOT_LENGTH || b.length % SLOT_LENGTH)
+          throw std::invalid_argument("break times must be multiple of the slot length");
+        if (std::none_of(base_.begin(), base_.end(), [&b](const span_t &s) { return s.first <= b.t0 && b.t1 <= s.second; }))
+          throw std::invalid_argument("break window outside of the shift time spans");
+
+        // centre of the window, after the previous break
+        unsigned int c = b.t0 + (b.t1 - std::min(b.t1, b.t0 + b.length)) / 2;
+        c              = std::max(t, c - c % SLOT_LENGTH);
+        if (c + b.length > b.t1)
+          throw std::invalid_argument("breaks do not fit in their windows");
+        placed_.push_back(c);
+        t = c + b.length;
+      }
+  };
+
+  void Shift::set_spans()
   {
-    unsigned int sz = stf.size();
+    span_.clear();
+    for (const auto &s : base_)
+      {
+        unsigned int t = s.first;
+        for (size_t i = 0; i < placed_.size(); i++)
+          {
+            unsigned int b0 = placed_[i], b1 = placed_[i] + breaks_[i].length;
+            if (b1 <= t || b0 >= s.second) continue;
+            if (b0 > t) span_.push_back(std::make_pair(t, b0));
+            t = std::max(t, b1);
+          }
+        if (t < s.second) span_.push_back(std::make_pair(t, s.second));
+      }
+
+    events_.clear();
     for (const auto &s : span_)
       {
-        unsigned int s0 = day * SLOTS_DAY + s.first / SLOT_LENGTH;
-        unsigned int s1 = day * SLOTS_DAY + s.second / SLOT_LENGTH;
-        for (unsigned int s = s0; s < s1 && s < sz; s++)
+        unsigned int s0 = s.first / SLOT_LENGTH;
+        unsigned int s1 = s.second / SLOT_LENGTH;
+        if (s0 >= s1) continue;
+        if (!events_.empty() && events_.back().first == s0)
+          events_.back().first = s1;
+        else
+          {
+            events_.emplace_back(s0, +1);
+            events_.emplace_back(s1, -1);
+          }
+      }
+  };
+
+  Shift Shift::place_breaks(const std::vector<double> &cost) const
+  {
+    if (breaks_.empty()) return *this;
+
+    // prefix sums of the slot costs
+    std::vector<double> sum(cost.size() + 1, 0.0);
+    for (size_t i = 0; i < cost.size(); i++)
+      sum[i + 1] = sum[i] + cost[i];
+    auto window_cost = [&sum](unsigned int k0, unsigned int k1) {
+      k0 = std::min<size_t>(k0, sum.size() - 1);
+      k1 = std::min<size_t>(k1, sum.size() - 1);
+      return sum[k1] - sum[k0];
+    };
+
+    // f[j][k]: minimum cost of the breaks up to j with the break j
+    // starting at the k-th slot of its window, the previous break is
+    // the cheapest one ending before, tracked with a running minimum
+    const double                           inf = std::numeric_limits<double>::infinity();
+    const size_t                           nb  = breaks_.size();
+    std::vector<unsigned int>              k0(nb);
+    std::vector<std::vector<double>>       f(nb);
+    std::vector<std::vector<unsigned int>> arg(nb);
+
+    for (size_t j = 0; j < nb; j++)
+      {
+        const break_t &b = breaks_[j];
+        unsigned int   n = b.length / SLOT_LENGTH;
+        k0[j]            = b.t0 / SLOT_LENGTH;
+        f[j].assign(b.t1 / SLOT_LENGTH - n - k0[j] + 1, inf);
+        arg[j].assign(f[j].size(), 0);
+
+        double       best = (j == 0) ? 0.0 : inf;
+        unsigned int barg = 0, p = 0;
+        for (unsigned int k = 0; k < f[j].size(); k++)
+          {
+            if (j > 0)
+              {
+                unsigned int m = breaks_[j - 1].length / SLOT_LENGTH;
+                for (; p < f[j - 1].size() && k0[j - 1] + p + m <= k0[j] + k; p++)
+                  if (f[j - 1][p] < best)
+                    {
+                      best = f[j - 1][p];
+                      barg = p;
+                    }
+              }
+            if (best < inf)
+              {
+                f[j][k]   = best + window_cost(k0[j] + k, k0[j] + k + n);
+                arg[j][k] = barg;
+              }
+          }
+      }
+
+    unsigned int k = std::min_element(f[nb - 1].begin(), f[nb - 1].end()) - f[nb - 1].begin();
+    if (f[nb - 1][k] == inf) return *this;
+
+    Shift sht{*this};
+    for (size_t j = nb; j-- > 0;)
+      {
+        sht.placed_[j] = (k0[j] + k) * SLOT_LENGTH;
+        k              = arg[j][k];
+      }
+    sht.set_spans();
+    return sht;
+  };
+
+  const std::vector<Shift::event_t> &Shift::events() const { return events_; };
+
+  void Shift::add_staff(unsigned int day, double c, std::vector<double> &stf) const
+  {
+    const unsigned int sz = stf.size();
+    for (size_t e = 0; e < events_.size(); e += 2)
+      {
+        unsigned int s0 = std::min(sz, day * SLOTS_DAY + events_[e].first);
+        unsigned int s1 = std::min(sz, day * SLOTS_DAY + events_[e + 1].first);
+        for (unsigned int s = s0; s < s1; s++)
           stf[s] += c;
       }
   };
 
+  void Shift::add_events(unsigned int day, double c, std::vector<double> &diff) const
+  {
+    if (diff.empty()) return;
+    const unsigned int last = diff.size() - 1;
+    for (const auto &e : events_)
+      diff[std::min(last, day * SLOTS_DAY + e.first)] += c * e.second;
+  };
+
   unsigned int Shift::staff(unsigned int t) const
   {
     if (span_.empty() || t < span_.front().first || t > span_.back().second)
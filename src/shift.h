@@ -15,10 +15,25 @@ namespace shift
   public:
     using span_t = std::pair<uint, uint>;
 
+    //! Coverage event: slot from the start of the day and staffing change
+    using event_t = std::pair<uint, int>;
+
+    //! Flexible break, a pause of given length placed inside a window
+    struct break_t
+    {
+      unsigned int t0;     // window start in minutes
+      unsigned int t1;     // window end in minutes
+      unsigned int length; // break length in minutes
+    };
+
+    //! Shift flags
+    static constexpr unsigned int FLAG_LATE  = 1 << 0;
+    static constexpr unsigned int FLAG_NIGHT = 1 << 1;
+
     Shift();
 
-    Shift(const std::string &code, const std::vector<span_t> &span);
-    Shift(const std::string &code, const std::vector<std::vector<int>> &span);
+    Shift(const std::string &code, const std::vector<span_t> &span, unsigned int flags = 0, const std::vector<break_t> &breaks = {});
+    Shift(const std::string &code, const std::vector<std::vector<int>> &span, unsigned int flags = 0, const std::vector<std::vector<int>> &breaks = {});
 
     bool operator==(const Shift &oth) const;
     bool operator!=(const Shift &oth) const;
@@ -44,22 +59,68 @@ namespace shift
     //! Work/rest flag
     bool work() const;
 
+    //! Working hours (precomputed from the time spans)
+    double hours() const;
+
+    //! Shift flags (late, night, ...)
+    unsigned int flags() const;
+
     //! Shift code
     const std::string code() const;
 
-    //! Shift working time spans
+    //! Shift working time spans (flexible breaks excluded)
     const std::vector<span_t> span() const;
 
+    //! Check whether the shift has flexible breaks
+    bool flexible() const;
+
+    //! Placed flexible breaks as time spans
+    const std::vector<span_t> breaks() const;
+
+    //! Best placement of the flexible breaks
+    /*! The cost of a break covering a slot is given per slot from the
+     *  beginning of the day (slots past the vector end cost nothing),
+     *  breaks are kept in order and cannot overlap. Return a copy of
+     *  the shift with the breaks placed at minimum total cost.
+     */
+    Shift place_breaks(const std::vector<double> &cost) const;
+
+    //! Coverage start/end events (adjacent spans merged)
+    const std::vector<event_t> &events() const;
+
     //! Update staffing curve
     void add_staff(unsigned int day, double c, std::vector<double> &stf) const;
 
+    //! Update a staffing difference array
+    /*! The difference array has one more value than the staffing curve,
+     *  the staffing is recovered with a prefix sum (events past the
+     *  curve end fall in the last value).
+     */
+    void add_events(unsigned int day, double c, std::vector<double> &diff) const;
+
     //! Shift staffing for a specific time
     unsigned int staff(unsigned int t) const;
 
   private:
-    bool                work_;
-    std::string         code_;
-    std::vector<span_t> span_;
+    bool                 work_;
+    std::string          code_;
+    std::vector<span_t>  span_;
+    std::vector<event_t> events_;
+    double               hours_;
+    unsigned int         flags_;
+
+    std::vector<span_t>       base_;   // working spans before the breaks
+    std::vector<break_t>      breaks_; // flexible break windows
+    std::vector<unsigned int> placed_; // flexible break start times
+
+    // validate the break windows and place the breaks at their centre
+    void set_breaks();
+
+    // working spans (and their events) from the base spans and the placed breaks
+    void set_spans();
+
+    // compute working hours from time spans
+    void set_hours();
   };
 
   //! Stream output
@@ -69,6 +130,23 @@ namespace shift
     return os;
   };
 
+  //! Minimum rest between shifts on consecutive days
+  /*! A working shift can be followed by a working shift on the next
+   *  day only if the time between the exit of the former (which can
+   *  spill over midnight) and the entry of the latter is at least the
+   *  minimum rest.
+   */
+  struct min_rest
+  {
+    unsigned int minutes;
+
+    bool operator()(const Shift &s0, const Shift &s1) const
+    {
+      if (!s0.work() || !s1.work()) return true;
+      return 24 * 60 + s1.t0() >= s0.t1() + minutes;
+    };
+  };
+
   //! Shift adapter equi-probability partitioning
   /*! Implement the following partitions:
    *
@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 #include "staff_energy.h"
 #include "config.h"
 
@@ -14,7 +18,7 @@ namespace staff_planner
     for (unsigned int i = slot0_; i < slot1_; i++)
       {
         double e = plan_.staffing_[i] - plan_.target_[i];
-        tmpE += e * e;
+        tmpE += plan_.weights_[i] * e * e;
       }
     return tmpE / (slot1_ - slot0_);
   };
@@ -27,7 +31,7 @@ namespace staff_planner
       {
         double e1 = mutd_stf[i] - prev_stf[i];
         double e2 = mutd_stf[i] - prev_stf[i] + 2 * plan_.staffing_[slot0_ + i] - 2 * plan_.target_[slot0_ + i];
-        tmpDe += e1 * e2;
+        tmpDe += plan_.weights_[slot0_ + i] * e1 * e2;
       }
     return tmpDe / n;
   };
@@ -39,11 +43,273 @@ namespace staff_planner
     for (unsigned int i = 0; i < 2 * SLOTS_DAY && off + i < plan_.staffing_.size(); i++)
       {
         double f = plan_.target_[off + i] - (plan_.staffing_[off + i] - sh0.staff(i * SLOT_LENGTH) + sh1.staff(i * SLOT_LENGTH));
-        fit += f * f;
+        fit += plan_.weights_[off + i] * f * f;
       }
     return fit / SLOTS_DAY;
   };
 
+  // tolerance used when comparing staffing with the minimum
+  const double SLACK_EPS = 1e-9;
+
+  deviation_energy::deviation_energy(const plan::Plan &plan, unsigned int week)
+    : plan_{plan}
+    , slot0_{week * 7 * SLOTS_DAY}
+    , slot1_{slot0_ + plan_.weekSlots()} {};
+
+  double deviation_energy::energy() const
+  {
+    double under = std::max(0.0, -plan_.errors_.min(slot0_, slot1_));
+    return under + plan_.slack_.count_below(slot0_, slot1_, -SLACK_EPS);
+  };
+
+  double deviation_energy::delta(const std::vector<plan::staffing_run_t> &runs) const
+  {
+    if (runs.empty()) return 0.0;
+
+    // minimum error over unchanged gaps and shifted runs
+    double       e_min = std::numeric_limits<double>::infinity();
+    double       count = 0.0;
+    unsigned int s     = slot0_;
+    for (const auto &r : runs)
+      {
+        e_min = std::min(e_min, plan_.errors_.min(s, r.slot0));
+        e_min = std::min(e_min, plan_.errors_.min(r.slot0, r.slot1) + r.delta);
+        count += static_cast<double>(plan_.slack_.count_below(r.slot0, r.slot1, -r.delta - SLACK_EPS));
+        count -= static_cast<double>(plan_.slack_.count_below(r.slot0, r.slot1, -SLACK_EPS));
+        s = r.slot1;
+      }
+    e_min = std::min(e_min, plan_.errors_.min(s, slot1_));
+
+    double under0 = std::max(0.0, -plan_.errors_.min(slot0_, slot1_));
+    double under1 = std::max(0.0, -e_min);
+    return under1 - under0 + count;
+  };
+
+  robust_energy::robust_energy(const plan::Plan &plan, unsigned int week)
+    : plan_{plan}
+    , slot0_{week * 7 * SLOTS_DAY}
+    , slot1_{slot0_ + plan_.weekSlots()}
+    , n_{slot1_ - slot0_}
+    , scenarios_{static_cast<unsigned int>(plan.scenarios_.size())}
+    , prefix_(static_cast<size_t>(scenarios_) * (n_ + 1), 0.0)
+    , c_(scenarios_, 0.0)
+    , d_(scenarios_, 0.0)
+    , q_{0.0}
+    , dd_(scenarios_, 0.0)
+  {
+    for (unsigned int s = 0; s < scenarios_; s++)
+      {
+        const std::vector<double> &d = plan_.scenarios_[s];
+        double *                   p = &prefix_[static_cast<size_t>(s) * (n_ + 1)];
+        for (unsigned int i = 0; i < n_; i++)
+          {
+            p[i + 1] = p[i] + plan_.weights_[slot0_ + i] * d[slot0_ + i];
+            c_[s] += plan_.weights_[slot0_ + i] * d[slot0_ + i] * d[slot0_ + i];
+          }
+      }
+    reset();
+  };
+
+  void robust_energy::reset()
+  {
+    q_ = 0.0;
+    for (unsigned int i = slot0_; i < slot1_; i++)
+      q_ += plan_.weights_[i] * plan_.staffing_[i] * plan_.staffing_[i];
+
+    for (unsigned int s = 0; s < scenarios_; s++)
+      {
+        const std::vector<double> &d = plan_.scenarios_[s];
+        double                     x = 0.0;
+        for (unsigned int i = slot0_; i < slot1_; i++)
+          x += plan_.weights_[i] * plan_.staffing_[i] * d[i];
+        d_[s] = x;
+      }
+  };
+
+  double robust_energy::robust(double q, const std::vector<double> &dd) const
+  {
+    double sum    = 0.0;
+    double sum_sq = 0.0;
+    for (unsigned int s = 0; s < scenarios_; s++)
+      {
+        double e = (q - 2.0 * (d_[s] + dd[s]) + c_[s]) / n_;
+        sum += e;
+        sum_sq += e * e;
+      }
+    double mean = sum / scenarios_;
+    return mean + plan_.scenarios_lambda_ * sqrt(std::max(0.0, sum_sq / scenarios_ - mean * mean));
+  };
+
+  double robust_energy::energy() const
+  {
+    if (scenarios_ == 0) return 0.0;
+    std::fill(dd_.begin(), dd_.end(), 0.0);
+    return robust(q_, dd_);
+  };
+
+  double robust_energy::delta(const std::vector<plan::staffing_run_t> &runs) const
+  {
+    if (scenarios_ == 0 || runs.empty()) return 0.0;
+
+    double e0 = energy();
+    double dq = 0.0;
+    for (const auto &r : runs)
+      for (unsigned int i = std::max(r.slot0, slot0_); i < std::min(r.slot1, slot1_); i++)
+        dq += plan_.weights_[i] * r.delta * (2.0 * plan_.staffing_[i] + r.delta);
+
+    for (unsigned int s = 0; s < scenarios_; s++)
+      {
+        const double *p = &prefix_[static_cast<size_t>(s) * (n_ + 1)];
+        double        x = 0.0;
+        for (const auto &r : runs)
+          {
+            unsigned int i0 = std::max(r.slot0, slot0_);
+            unsigned int i1 = std::min(r.slot1, slot1_);
+            if (i0 < i1) x += r.delta * (p[i1 - slot0_] - p[i0 - slot0_]);
+          }
+        dd_[s] = x;
+      }
+
+    return robust(q_ + dq, dd_) - e0;
+  };
+
+  void robust_energy::apply(const plan::staffing_run_t &run)
+  {
+    unsigned int i0 = std::max(run.slot0, slot0_);
+    unsigned int i1 = std::min(run.slot1, slot1_);
+    if (scenarios_ == 0 || i0 >= i1) return;
+
+    for (unsigned int i = i0; i < i1; i++)
+      q_ += plan_.weights_[i] * run.delta * (2.0 * plan_.staffing_[i] + run.delta);
+    for (unsigned int s = 0; s < scenarios_; s++)
+      {
+        const double *p = &prefix_[static_cast<size_t>(s) * (n_ + 1)];
+        d_[s] += run.delta * (p[i1 - slot0_] - p[i0 - slot0_]);
+      }
+  };
+
+  contract_energy::contract_energy(const plan::Plan &plan, unsigned int week)
+    : plan_{plan}
+    , week_{week}
+    , worked_(plan.plan_.size(), 0.0)
+    , contract_(plan.plan_.size(), -1.0)
+    , agents_{0}
+    , sum_sq_{0.0}
+  {
+    reset();
+  };
+
+  void contract_energy::reset()
+  {
+    agents_ = 0;
+    sum_sq_ = 0.0;
+    for (unsigned int i = 0; i < plan_.plan_.size(); i++)
+      {
+        worked_[i]   = plan_.agentHours(i, 0, (week_ + 1) * 7);
+        contract_[i] = plan_.contract_hours_[i] < 0.0 ? -1.0 : plan_.contract_hours_[i] * (week_ + 1);
+        if (contract_[i] < 0.0) continue;
+        double d = worked_[i] - contract_[i];
+        sum_sq_ += d * d;
+        agents_++;
+      }
+  };
+
+  double contract_energy::energy() const
+  {
+    return agents_ == 0 ? 0.0 : sum_sq_ / agents_;
+  };
+
+  double contract_energy::delta(unsigned int mutd_idx, double prev_hrs, double mutd_hrs) const
+  {
+    if (contract_[mutd_idx] < 0.0) return 0.0;
+    double d0 = worked_[mutd_idx] - contract_[mutd_idx];
+    double d1 = d0 + mutd_hrs - prev_hrs;
+    return (d1 * d1 - d0 * d0) / agents_;
+  };
+
+  void contract_energy::apply(unsigned int mutd_idx, double prev_hrs, double mutd_hrs)
+  {
+    if (contract_[mutd_idx] < 0.0)
+      {
+        worked_[mutd_idx] += mutd_hrs - prev_hrs;
+        return;
+      }
+    double d0 = worked_[mutd_idx] - contract_[mutd_idx];
+    worked_[mutd_idx] += mutd_hrs - prev_hrs;
+    double d1 = worked_[mutd_idx] - contract_[mutd_idx];
+    sum_sq_ += d1 * d1 - d0 * d0;
+  };
+
+  fairness_energy::fairness_energy(const plan::Plan &plan, unsigned int week)
+    : plan_{plan}
+    , week_{week}
+    , burden_(plan.plan_.size(), 0.0)
+    , team_sum_(plan.teams(), 0.0)
+    , team_sum_sq_(plan.teams(), 0.0)
+    , team_size_(plan.teams(), 0.0)
+  {
+    reset();
+  };
+
+  double fairness_energy::burden(unsigned int day, const shift::Shift &sht)
+  {
+    if (!sht.work()) return 0.0;
+    double b = day % 7 >= 5 ? 1.0 : 0.0;
+    if (sht.flags() & (shift::Shift::FLAG_LATE | shift::Shift::FLAG_NIGHT)) b += 1.0;
+    return b;
+  };
+
+  void fairness_energy::reset()
+  {
+    std::fill(team_sum_.begin(), team_sum_.end(), 0.0);
+    std::fill(team_sum_sq_.begin(), team_sum_sq_.end(), 0.0);
+    std::fill(team_size_.begin(), team_size_.end(), 0.0);
+    for (unsigned int i = 0; i < plan_.plan_.size(); i++)
+      {
+        burden_[i] = 0.0;
+        for (unsigned int day = 0; day < plan_.plan_[i].size(); day++)
+          burden_[i] += burden(day, plan_.plan_[i][day]);
+        unsigned int t = plan_.agent_team_[i];
+        team_sum_[t] += burden_[i];
+        team_sum_sq_[t] += burden_[i] * burden_[i];
+        team_size_[t] += 1.0;
+      }
+  };
+
+  double fairness_energy::energy() const
+  {
+    double tmpE = 0.0;
+    for (unsigned int t = 0; t < team_size_.size(); t++)
+      {
+        if (team_size_[t] == 0.0) continue;
+        double m = team_sum_[t] / team_size_[t];
+        tmpE += team_sum_sq_[t] / team_size_[t] - m * m;
+      }
+    return tmpE;
+  };
+
+  double fairness_energy::delta(unsigned int mutd_idx, double prev_brd, double mutd_brd) const
+  {
+    unsigned int t  = plan_.agent_team_[mutd_idx];
+    double       n  = team_size_[t];
+    double       b0 = burden_[mutd_idx];
+    double       b1 = b0 + mutd_brd - prev_brd;
+    double       s0 = team_sum_[t];
+    double       s1 = s0 + b1 - b0;
+    // Var = S2/n - S1^2/n^2
+    return (b1 * b1 - b0 * b0) / n - (s1 * s1 - s0 * s0) / (n * n);
+  };
+
+  void fairness_energy::apply(unsigned int mutd_idx, double prev_brd, double mutd_brd)
+  {
+    unsigned int t  = plan_.agent_team_[mutd_idx];
+    double       b0 = burden_[mutd_idx];
+    double       b1 = b0 + mutd_brd - prev_brd;
+    burden_[mutd_idx] = b1;
+    team_sum_[t] += b1 - b0;
+    team_sum_sq_[t] += b1 * b1 - b0 * b0;
+  };
+
   comfort_energy::comfort_energy(const plan::Plan &plan, unsigned int week)
     : plan_{plan}
     , week_{week} {};
@@ -7,10 +7,10 @@
 namespace staff_planner
 {
   //! Staffing energy term
-  /*! Sum of squared difference between current and target staffing
-   *  curves
+  /*! Weighted sum of squared difference between current and target
+   *  staffing curves
    *
-   *  E = Sum_i (target_i - staffing_i)^2
+   *  E = Sum_i w_i (target_i - staffing_i)^2
    *
    */
   struct staffing_energy
@@ -28,6 +28,138 @@ namespace staff_planner
     const unsigned int slot1_;
   };
 
+  //! Worst understaffing and minimum staffing violations
+  /*! Maximum understaffing over the week plus the number of slots
+   *  where staffing falls below the minimum staffing curve
+   *
+   *  E = max_i (target_i - staffing_i)^+ + #{i : staffing_i < minimum_i}
+   *
+   *  both terms are evaluated on the plan error trees, the delta only
+   *  visits the ranges changed by the mutation.
+   */
+  struct deviation_energy
+  {
+    deviation_energy(const plan::Plan &plan, unsigned int week);
+
+    double energy() const;
+
+    double delta(const std::vector<plan::staffing_run_t> &runs) const;
+
+    const plan::Plan&  plan_;
+    const unsigned int slot0_;
+    const unsigned int slot1_;
+  };
+
+  //! Robust staffing energy over demand scenarios
+  /*! Mean plus lambda times the standard deviation of the weighted
+   *  staffing energy against each scenario s
+   *
+   *  E_s = Sum_i w_i (d_si - staffing_i)^2 / n = (Q - 2 D_s + C_s) / n
+   *  E   = mean_s(E_s) + lambda * stddev_s(E_s)
+   *
+   *  with Q = Sum_i w_i staffing_i^2, D_s = Sum_i w_i staffing_i d_si
+   *  and C_s = Sum_i w_i d_si^2. The prefix sums of w_i d_si are
+   *  precomputed so that a staffing run only costs O(S) per scenario
+   *  update.
+   */
+  struct robust_energy
+  {
+    robust_energy(const plan::Plan &plan, unsigned int week);
+
+    //! Recompute the scenario sums from the plan
+    void reset();
+
+    double energy() const;
+
+    double delta(const std::vector<plan::staffing_run_t> &runs) const;
+
+    //! Apply a run before it is added to the staffing
+    void apply(const plan::staffing_run_t &run);
+
+    const plan::Plan&   plan_;
+    const unsigned int  slot0_;
+    const unsigned int  slot1_;
+    const unsigned int  n_;
+    const unsigned int  scenarios_;
+    std::vector<double> prefix_;
+    std::vector<double> c_;
+    std::vector<double> d_;
+    double              q_;
+
+  private:
+    // mean plus lambda stddev of the scenario energies for q and d + dd * k
+    double robust(double q, const std::vector<double> &dd) const;
+
+    mutable std::vector<double> dd_;
+  };
+
+  //! Contract hours balance
+  /*! Squared difference between the hours worked by each agent from
+   *  the start of the plan to the end of the planned week and its
+   *  contract hours over the same period
+   *
+   *  E = Sum_a (worked_a - contract_a)^2 / agents
+   *
+   *  only agents with a contract are considered. The worked hours are
+   *  kept per agent and updated when a mutation is applied so that the
+   *  delta only depends on the hours of the replaced week line.
+   */
+  struct contract_energy
+  {
+    contract_energy(const plan::Plan &plan, unsigned int week);
+
+    //! Recompute worked hours from the plan
+    void reset();
+
+    double energy() const;
+
+    double delta(unsigned int mutd_idx, double prev_hrs, double mutd_hrs) const;
+
+    void apply(unsigned int mutd_idx, double prev_hrs, double mutd_hrs);
+
+    const plan::Plan&   plan_;
+    const unsigned int  week_;
+    std::vector<double> worked_;
+    std::vector<double> contract_;
+    unsigned int        agents_;
+    double              sum_sq_;
+  };
+
+  //! Fairness of weekend and late shifts
+  /*! Sum over teams of the variance of the number of burdensome shifts
+   *  (weekend working days and late or night shifts) assigned to each
+   *  agent of the team over the whole plan
+   *
+   *  E = Sum_t Var_{a in t}(burden_a)
+   *
+   *  the burden of each agent and the first two moments of each team
+   *  are kept and updated when a mutation is applied, so that the delta
+   *  only depends on the burden of the replaced week line.
+   */
+  struct fairness_energy
+  {
+    fairness_energy(const plan::Plan &plan, unsigned int week);
+
+    //! Burden of a shift assigned on a plan day (weeks start on monday)
+    static double burden(unsigned int day, const shift::Shift &sht);
+
+    //! Recompute burdens from the plan
+    void reset();
+
+    double energy() const;
+
+    double delta(unsigned int mutd_idx, double prev_brd, double mutd_brd) const;
+
+    void apply(unsigned int mutd_idx, double prev_brd, double mutd_brd);
+
+    const plan::Plan&   plan_;
+    const unsigned int  week_;
+    std::vector<double> burden_;
+    std::vector<double> team_sum_;
+    std::vector<double> team_sum_sq_;
+    std::vector<double> team_size_;
+  };
+
   //! Spread of entry times across plan
   struct comfort_energy
   {
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+
+#include "anneal.h"
+#include "plan.h"
+#include "staff_state.h"
+
+namespace staff_planner
+{
+  //! Population based search over plans
+  /*! The evolution keeps a population of plans, each one with its own
+   *  planner state, and at every generation:
+   *
+   *  1. chooses the parents by binary tournament on the total energy
+   *  2. builds the offspring taking each agent week line (or a whole
+   *     team block when the plan has teams) from either parent, lines
+   *     are sampler words so the offspring is always valid
+   *  3. performs a short Metropolis walk on the offspring at the
+   *     generation temperature
+   *  4. keeps the best individuals among parents and offspring
+   *
+   *  Offspring are built and evaluated in parallel, each one on its
+   *  own plan and state with the incremental energies. The temperature
+   *  decreases geometrically over the generations.
+   */
+  template <typename S>
+  class Evolution
+  {
+  public:
+    //! Create a population of sampled plans
+    /*!
+     * @param samplers agents samplers
+     * @param week     week to plan
+     * @param plan     the plan to start from
+     * @param weights  calibrated energy weights
+     * @param size     population size
+     * @param nover    Metropolis steps for each offspring
+     */
+    Evolution(const std::vector<sampler_t> &samplers, unsigned int week, const plan::Plan &plan, const energy_weights_t &weights, unsigned int size, unsigned int nover)
+      : rne_{}
+      , samplers_{samplers}
+      , week_{week}
+      , weights_{weights}
+      , nover_{nover}
+      , threads_{std::max(1u, std::thread::hardware_concurrency())}
+      , population_(size)
+    {
+      if (size < 2) throw std::invalid_argument{"population size must be at least 2"};
+
+      std::random_device device;
+      rne_.seed((static_cast<uint64_t>(device()) << 32) | device());
+
+      std::vector<uint64_t> seeds(size);
+      for (auto &s : seeds) s = rne_();
+
+      parallel(size, [&](unsigned int i) {
+        auto &ind = population_[i];
+        ind.plan  = std::make_unique<plan::Plan>(plan);
+        ind.state = std::make_unique<S>(samplers_, week_, *ind.plan, true, seeds[i]);
+        ind.state->setWeights(weights_);
+        ind.energy = ind.state->energy();
+      });
+      sort();
+    };
+
+    //! Evolve the population from temperature ti to tf
+    void evolve(double ti, double tf, unsigned int generations)
+    {
+      if (ti <= 0 || tf <= 0 || ti <= tf) throw std::invalid_argument{"invalid temperature range"};
+      if (generations == 0) throw std::invalid_argument{"generations must be positive"};
+
+      const unsigned int size = population_.size();
+
+      std::cout
+        << "starting " << generations << " generations"
+        << " of " << size << " plans"
+        << " on " << threads_ << " threads ..."
+        << "\n"
+        << std::flush;
+
+      double temp  = ti;
+      double delta = generations > 1 ? pow(tf / ti, 1.0 / (generations - 1)) : 1.0;
+      for (unsigned int g = 1; g <= generations; g++)
+        {
+          // choose parents and crossover masks sequentially
+          std::vector<offspring_t> offspring(size);
+          for (auto &o : offspring)
+            {
+              o.parent0 = tournament();
+              o.parent1 = tournament();
+              o.mask    = crossover_mask();
+              o.seed    = rne_();
+            }
+
+          std::vector<individual_t> children(size);
+          parallel(size, [&](unsigned int i) { children[i] = breed(offspring[i], temp); });
+
+          for (auto &c : children)
+            population_.push_back(std::move(c));
+          sort();
+          population_.resize(size);
+
+          std::cout
+            << std::setw(3) << (100 * g / generations) << "%"
+            << " T=" << std::fixed << std::setprecision(4) << temp
+            << " E=" << std::fixed << std::setprecision(4) << population_.front().energy
+            << " (worst " << std::fixed << std::setprecision(4) << population_.back().energy << ") ..."
+            << "\n"
+            << std::flush;
+
+          temp *= delta;
+        }
+    };
+
+    //! The best plan in the population
+    const plan::Plan &best() const
+    {
+      return *population_.front().plan;
+    };
+
+    //! Energy of the best plan
+    double energy() const
+    {
+      return population_.front().energy;
+    };
+
+  private:
+    struct individual_t
+    {
+      std::unique_ptr<plan::Plan> plan;
+      std::unique_ptr<S>          state;
+      double                      energy = 0.0;
+    };
+
+    struct offspring_t
+    {
+      unsigned int      parent0 = 0;
+      unsigned int      parent1 = 0;
+      std::vector<bool> mask;
+      uint64_t          seed = 0;
+    };
+
+    std::mt19937_64 rne_;
+
+    std::vector<sampler_t> samplers_;
+    unsigned int           week_;
+    energy_weights_t       weights_;
+    unsigned int           nover_;
+    unsigned int           threads_;
+
+    std::vector<individual_t> population_;
+
+    // run job(0), ..., job(n - 1) over the threads
+    void parallel(unsigned int n, const std::function<void(unsigned int)> &job)
+    {
+      std::atomic<unsigned int> next{0};
+      auto                      worker = [&]() {
+        plan::worker_scope scope;
+        for (unsigned int i = next++; i < n; i = next++)
+          job(i);
+      };
+
+      std::vector<std::thread> pool;
+      for (unsigned int t = 1; t < std::min(threads_, n); t++)
+        pool.emplace_back(worker);
+      worker();
+      for (auto &t : pool)
+        t.join();
+    };
+
+    void sort()
+    {
+      std::stable_sort(population_.begin(), population_.end(), [](const individual_t &a, const individual_t &b) { return a.energy < b.energy; });
+    };
+
+    // binary tournament
+    unsigned int tournament()
+    {
+      std::uniform_int_distribution<size_t> dist{0, population_.size() - 1};
+
+      unsigned int a = dist(rne_);
+      unsigned int b = dist(rne_);
+      return population_[a].energy <= population_[b].energy ? a : b;
+    };
+
+    // agents whose line comes from the second parent, whole teams are
+    // exchanged half of the times when the plan has teams
+    std::vector<bool> crossover_mask()
+    {
+      const plan::Plan &plan = *population_.front().plan;
+      const size_t      n    = plan.plan_.size();
+
+      std::bernoulli_distribution coin{0.5};
+      std::vector<bool>           mask(n);
+      if (plan.teams() > 1 && coin(rne_))
+        {
+          std::vector<bool> team(plan.teams());
+          for (size_t t = 0; t < team.size(); t++)
+            team[t] = coin(rne_);
+          for (size_t i = 0; i < n; i++)
+            mask[i] = team[plan.agent_team_[i]];
+        }
+      else
+        for (size_t i = 0; i < n; i++)
+          mask[i] = coin(rne_);
+      return mask;
+    };
+
+    // build the offspring and perform a Metropolis walk on it
+    individual_t breed(const offspring_t &o, double temp) const
+    {
+      const plan::Plan &p1 = *population_[o.parent1].plan;
+
+      individual_t child;
+      child.plan = std::make_unique<plan::Plan>(*population_[o.parent0].plan);
+
+      // staffing change of the swapped lines as a difference array
+      std::vector<double> &stf = child.plan->staffing_;
+      std::vector<double>  diff(stf.size() + 1, 0.0);
+      for (size_t i = 0; i < o.mask.size(); i++)
+        {
+          if (!o.mask[i]) continue;
+          for (unsigned int day = week_ * 7; day < (week_ + 1) * 7; day++)
+            {
+              child.plan->plan_[i][day].add_events(day, -1, diff);
+              p1.plan_[i][day].add_events(day, +1, diff);
+              child.plan->plan_[i][day] = p1.plan_[i][day];
+            }
+        }
+      double d = 0.0;
+      for (size_t i = 0; i < stf.size(); i++)
+        {
+          d += diff[i];
+          stf[i] += d;
+        }
+
+      child.state = std::make_unique<S>(samplers_, week_, *child.plan, false, o.seed);
+      child.state->setWeights(weights_);
+
+      anneal::Anneal<S> anneal{nover_, *child.state};
+      anneal.sweep(temp, nover_);
+
+      child.energy = child.state->energy();
+      return child;
+    };
+  };
+}
@@ -1,9 +1,17 @@
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <exception>
 #include <iomanip>
+#include <limits>
 #include <map>
+#include <memory>
+#include <optional>
+#include <random>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "config.h"
@@ -16,12 +24,19 @@
 #include "regexp.h"
 
 #include "anneal.h"
+#include "local_search.h"
 
 #include "staff_energy.h"
+#include "staff_evolve.h"
 #include "staff_state.h"
 
 #include "staff_planner.h"
 
+// rules compiled ahead of time by a site build (see tools/compile_rules.py)
+#ifdef PYWFPLAN_RULES
+#include PYWFPLAN_RULES
+#endif
+
 namespace staff_planner
 {
   //! Create a planner
@@ -34,9 +49,24 @@ namespace staff_planner
   StaffPlanner::StaffPlanner(const std::string &description, const plan::Plan &plan, double temp_sched, double comfort_weight)
     : temp_sched_{temp_sched}
     , comfort_weight_{comfort_weight}
+    , deviation_weight_{0.0}
+    , contract_weight_{0.0}
+    , fairness_weight_{0.0}
+    , robust_weight_{0.0}
+    , min_rest_{0}
+    , population_{0}
+    , generations_{0}
+    , engine_{"anneal"}
+    , passes_{0}
+    , parameter_{0.0}
+    , repair_n_{0}
+    , cold_{0.0}
     , week_{0}
+    , lazy_{false}
+    , warmup_{0}
     , plan_{plan}
     , samplers_(plan_.plan_.size(), sampler_t{regexp::RegExp<shift::Shift>::zero})
+    , availability_(plan_.plan_.size())
     , report_{}
     , description_{description}
   {
@@ -50,13 +80,24 @@ namespace staff_planner
     std::stringstream ss;
     ss
       << "Planner:\n"
-      << "           description: " << description_ << "\n"
-      << "        turning length: " << plan_.days() << "\n"
-      << "           slot length: " << SLOT_LENGTH << " minutes\n"
-      << "             agents n°: " << samplers_.size() << "\n"
-      << "       target staffing: " << std::fixed << std::setprecision(2) << plan_.hours().target << " hrs\n"
-      << " comfort energy weight: " << std::setprecision(5) << comfort_weight_ << "\n"
-      << "  temperature schedule: " << std::fixed << std::setprecision(2) << temp_sched_ << "\n";
+      << "            description: " << description_ << "\n"
+      << "         turning length: " << plan_.days() << "\n"
+      << "            slot length: " << SLOT_LENGTH << " minutes\n"
+      << "              agents n°: " << samplers_.size() << "\n"
+      << "        target staffing: " << std::fixed << std::setprecision(2) << plan_.hours().target << " hrs\n"
+      << "  comfort energy weight: " << std::setprecision(5) << comfort_weight_ << "\n"
+      << "deviation energy weight: " << std::setprecision(5) << deviation_weight_ << "\n"
+      << " contract energy weight: " << std::setprecision(5) << contract_weight_ << "\n"
+      << " fairness energy weight: " << std::setprecision(5) << fairness_weight_ << "\n"
+      << "   robust energy weight: " << std::setprecision(5) << robust_weight_ << "\n"
+      << "           minimum rest: " << min_rest_ << " minutes\n"
+      << "             population: " << population_ << " plans x " << generations_ << " generations\n"
+      << "                 engine: " << engine_ << "\n"
+      << "          repair agents: " << repair_n_ << "\n"
+      << "             cold phase: " << std::setprecision(5) << cold_ << "\n"
+      << "          lazy samplers: " << (lazy_ ? "yes (warm-up " + std::to_string(warmup_) + ")" : "no") << "\n"
+      << "          shift weights: " << (shift_weights_.empty() ? "no" : std::to_string(shift_weights_.size()) + " shifts") << "\n"
+      << "   temperature schedule: " << std::fixed << std::setprecision(2) << temp_sched_ << "\n";
     return ss.str();
   };
 
@@ -68,15 +109,285 @@ namespace staff_planner
     week_ = w;
   };
 
+  //! Set deviation energy weight (relative to staffing energy)
+  void StaffPlanner::setDeviationWeight(double deviation_weight)
+  {
+    if (deviation_weight < 0.0) throw std::invalid_argument{"deviation energy weight must be positive"};
+    deviation_weight_ = deviation_weight;
+  };
+
+  //! Set contract hours energy weight (relative to staffing energy)
+  void StaffPlanner::setContractWeight(double contract_weight)
+  {
+    if (contract_weight < 0.0) throw std::invalid_argument{"contract energy weight must be positive"};
+    contract_weight_ = contract_weight;
+  };
+
+  //! Set fairness energy weight (relative to staffing energy)
+  void StaffPlanner::setFairnessWeight(double fairness_weight)
+  {
+    if (fairness_weight < 0.0) throw std::invalid_argument{"fairness energy weight must be positive"};
+    fairness_weight_ = fairness_weight;
+  };
+
+  //! Set robust energy weight (relative to staffing energy)
+  void StaffPlanner::setRobustWeight(double robust_weight)
+  {
+    if (robust_weight < 0.0) throw std::invalid_argument{"robust energy weight must be positive"};
+    if (robust_weight > 0.0 && plan_.scenarios_.empty()) throw std::invalid_argument{"robust energy needs some demand scenarios"};
+    robust_weight_ = robust_weight;
+  };
+
+  //! Set minimum rest between shifts on consecutive days (in minutes)
+  void StaffPlanner::setMinimumRest(int minutes)
+  {
+    if (minutes < 0 || minutes > 24 * 60) throw std::invalid_argument{"invalid minimum rest (must be between 0 and 24*60 minutes)"};
+    min_rest_ = static_cast<uint>(minutes);
+  };
+
+  //! Set the evolutionary mode (population 0 disables it)
+  void StaffPlanner::setEvolution(int population, int generations)
+  {
+    if (population < 0 || population == 1) throw std::invalid_argument{"invalid population size (must be 0 or at least 2)"};
+    if (population > 0 && generations <= 0) throw std::invalid_argument{"generations must be positive"};
+    population_  = static_cast<uint>(population);
+    generations_ = population_ > 0 ? static_cast<uint>(generations) : 0;
+  };
+
+  //! Set the optimization engine
+  void StaffPlanner::setEngine(const std::string &engine, int passes, double parameter)
+  {
+    if (engine != "anneal" && engine != "lahc" && engine != "threshold" && engine != "rrt")
+      throw std::invalid_argument{"invalid engine (must be one of anneal, lahc, threshold, rrt)"};
+    if (engine != "anneal" && passes <= 0) throw std::invalid_argument{"passes must be positive"};
+    engine_    = engine;
+    passes_    = engine != "anneal" ? static_cast<uint>(passes) : 0;
+    parameter_ = parameter;
+  };
+
+  //! Set the number of agents freed by the large neighbourhood move
+  void StaffPlanner::setRepairSize(int agents)
+  {
+    if (agents < 0) throw std::invalid_argument{"repair size must be positive"};
+    repair_n_ = static_cast<uint>(agents);
+  };
+
+  //! Set the rejection-free cold phase (0 disables it)
+  void StaffPlanner::setColdPhase(double acceptance)
+  {
+    if (acceptance < 0.0 || acceptance >= 1.0) throw std::invalid_argument{"invalid cold phase acceptance (must be between 0 and 1)"};
+    cold_ = acceptance;
+  };
+
   //! Set a sampler for an agent
   /*! The agent's planning is defined by a regular expression over the
    *  Shift class which is not suitable for sampling. Thus we map the
    *  regular expression type to ShiftAdapter then we build the Fsm
-   *  and add it to the samplers.
+   *  and add it to the samplers (a rule compiled ahead of time is loaded
+   *  from its tables).
    */
   void StaffPlanner::setAgentSampler(const std::string &agent, const regexp::RegExp<shift::Shift> &regexp)
   {
-    samplers_[plan_.getAgentIndex(agent)] = sampler_t{regexp};
+    if (const fsm::compiled_t *compiled = fsm::find_compiled(regexp, fsm::backend_t::brzozowski))
+      {
+        samplers_[plan_.getAgentIndex(agent)] = sampler_t{regexp, *compiled};
+        return;
+      }
+    samplers_[plan_.getAgentIndex(agent)] = sampler_t{regexp, lazy_};
+    samplers_[plan_.getAgentIndex(agent)].warmup(warmup_);
+  };
+
+  //! Set the lazy samplers mode
+  void StaffPlanner::setLazySamplers(bool lazy, int warmup)
+  {
+    if (warmup < 0) throw std::invalid_argument{"warm-up must be positive"};
+    lazy_   = lazy;
+    warmup_ = static_cast<uint>(warmup);
+  };
+
+  //! Set the sampling weights of the shifts
+  void StaffPlanner::setShiftWeights(const std::vector<std::string> &codes, const std::vector<double> &weights)
+  {
+    if (codes.size() != weights.size()) throw std::invalid_argument{"shift codes and weights must have the same size"};
+    std::map<std::string, double> shift_weights;
+    for (size_t i = 0; i < codes.size(); i++)
+      {
+        if (!(weights[i] > 0.0) || weights[i] == std::numeric_limits<double>::infinity()) throw std::invalid_argument{"shift weights must be positive"};
+        shift_weights[codes[i]] = weights[i];
+      }
+    shift_weights_ = shift_weights;
+  };
+
+  //! Set the samplers of many agents at once
+  /*! The unique rules are pulled by worker threads from a shared
+   *  counter, an error compiling a rule is raised once all the workers
+   *  are done and no sampler is changed.
+   */
+  std::vector<rule_stat_t> StaffPlanner::setAgentSamplers(const std::vector<std::string> &agents, const std::vector<regexp::RegExp<shift::Shift>> &regexps, const std::vector<std::string> &backends)
+  {
+    using clock_t = std::chrono::high_resolution_clock;
+    using sec_t   = std::chrono::duration<double>;
+
+    if (agents.size() != regexps.size()) throw std::invalid_argument{"agents and rules must have the same size"};
+    if (!backends.empty() && backends.size() != regexps.size()) throw std::invalid_argument{"rules and backends must have the same size"};
+
+    // unique rules (for each backend) and their agents
+    std::map<fsm::backend_t, std::unordered_map<regexp::RegExp<shift::Shift>, size_t>> rule_m;
+    std::vector<size_t>                                                               agent_rule(agents.size());
+    std::vector<size_t>                                                               agent_idx(agents.size());
+    std::vector<rule_stat_t>                                                          stats;
+    for (size_t a = 0; a < agents.size(); a++)
+      {
+        const std::string backend = backends.empty() ? "brzozowski" : backends[a];
+        agent_idx[a]              = plan_.getAgentIndex(agents[a]);
+        auto r                    = rule_m[fsm::to_backend(backend)].insert(std::make_pair(regexps[a], stats.size()));
+        if (r.second) stats.push_back(rule_stat_t{regexps[a].to_string(), backend, false, 0, 0, 0, 0.0});
+        agent_rule[a] = r.first->second;
+        stats[agent_rule[a]].agents++;
+      }
+
+    std::vector<const regexp::RegExp<shift::Shift> *> rules(stats.size());
+    for (const auto &b : rule_m)
+      for (const auto &r : b.second)
+        rules[r.second] = &r.first;
+
+    std::vector<sampler_t>          samplers(stats.size());
+    std::vector<std::exception_ptr> errors(stats.size());
+    std::atomic<size_t>             next{0};
+    auto                            worker = [&]() {
+      for (size_t k = next++; k < rules.size(); k = next++)
+        try
+          {
+            clock_t::time_point    t0       = clock_t::now();
+            const fsm::backend_t   backend  = fsm::to_backend(stats[k].backend);
+            const fsm::compiled_t *compiled = fsm::find_compiled(*rules[k], backend);
+            if (compiled)
+              samplers[k] = sampler_t{*rules[k], *compiled};
+            else
+              {
+                samplers[k] = sampler_t{*rules[k], lazy_, backend};
+                samplers[k].warmup(warmup_);
+              }
+            stats[k].precompiled   = compiled != nullptr;
+            stats[k].seconds       = std::chrono::duration_cast<sec_t>(clock_t::now() - t0).count();
+            stats[k].states        = static_cast<uint>(samplers[k].states());
+            stats[k].transitions   = static_cast<uint>(samplers[k].transitions());
+          }
+        catch (...)
+          {
+            errors[k] = std::current_exception();
+          }
+    };
+
+    const size_t             threads = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), rules.size()));
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; t++)
+      workers.emplace_back(worker);
+    worker();
+    for (auto &w : workers)
+      w.join();
+
+    for (const auto &e : errors)
+      if (e) std::rethrow_exception(e);
+
+    // agents sharing a rule must not share the random sequence
+    std::random_device device;
+    std::vector<bool>  used(samplers.size(), false);
+    for (size_t a = 0; a < agents.size(); a++)
+      {
+        samplers_[agent_idx[a]] = samplers[agent_rule[a]];
+        if (used[agent_rule[a]]) samplers_[agent_idx[a]].seed((static_cast<uint64_t>(device()) << 32) | device());
+        used[agent_rule[a]] = true;
+      }
+
+    return stats;
+  };
+
+  //! Set the shifts an agent is available for on a day of the plan
+  void StaffPlanner::setAgentAvailability(const std::string &agent, int day, const std::vector<std::string> &codes)
+  {
+    if (day < 0 || static_cast<uint>(day) >= plan_.days()) throw std::invalid_argument{"day exceed plan length"};
+
+    auto &availability = availability_[plan_.getAgentIndex(agent)];
+    if (codes.empty())
+      availability.erase(static_cast<uint>(day));
+    else
+      availability[static_cast<uint>(day)] = std::set<std::string>{codes.begin(), codes.end()};
+  };
+
+  //! Samplers with the minimum rest constraint compiled in, the shift
+  //! weights and the availability masks of the planned week
+  /*! The first shift must also respect the rest after the previous
+   *  week. The mask of an agent allows on each day of the week the
+   *  letters of the sampler whose code is available.
+   */
+  std::vector<sampler_t> StaffPlanner::compile() const
+  {
+    std::vector<sampler_t> samplers{samplers_};
+    if (min_rest_ > 0)
+      for (unsigned int i = 0; i < samplers.size(); i++)
+        {
+          std::optional<shift::Shift> before;
+          if (week_ > 0) before = plan_.plan_[i][week_ * 7 - 1];
+          samplers[i].constrain(shift::min_rest{min_rest_}, before);
+        }
+
+    // the lazy samplers sharing their states are weighed once
+    if (!shift_weights_.empty())
+      {
+        auto weights = std::make_shared<const std::map<std::string, double>>(shift_weights_);
+        std::vector<unsigned int> weighed;
+        for (unsigned int i = 0; i < samplers.size(); i++)
+          {
+            const auto k_i = std::find_if(weighed.begin(), weighed.end(), [&](unsigned int k) {
+              return samplers[i].lazy() && samplers[k].lazy() && samplers_[k].shares(samplers_[i]);
+            });
+            if (k_i != weighed.end())
+              {
+                samplers[i].shareWeights(samplers[*k_i]);
+                continue;
+              }
+            samplers[i].setWeights([weights](const shift::Shift &s) {
+              const auto w_i = weights->find(s.code());
+              return w_i == weights->end() ? 1.0 : w_i->second;
+            });
+            weighed.push_back(i);
+          }
+      }
+
+    for (unsigned int i = 0; i < samplers.size(); i++)
+      {
+        const auto &availability = availability_[i];
+        const auto  day0         = availability.lower_bound(week_ * 7);
+        if (day0 == availability.end() || day0->first >= (week_ + 1) * 7) continue;
+
+        std::vector<std::vector<bool>> mask(7, std::vector<bool>(samplers[i].letters(), true));
+        for (auto d = day0; d != availability.end() && d->first < (week_ + 1) * 7; ++d)
+          for (size_t lt = 0; lt < samplers[i].letters(); lt++)
+            mask[d->first - week_ * 7][lt] = d->second.count(samplers[i].letter(lt).code()) > 0;
+
+        try
+          {
+            samplers[i].setMask(mask);
+          }
+        catch (const std::invalid_argument &)
+          {
+            throw std::invalid_argument{"no week satisfies the availability of agent " + plan_.getAgentCode(i)};
+          }
+      }
+    return samplers;
+  };
+
+  //! Energy weights (before calibration)
+  energy_weights_t StaffPlanner::weights() const
+  {
+    energy_weights_t weights;
+    weights.comfort   = comfort_weight_;
+    weights.deviation = deviation_weight_;
+    weights.contract  = contract_weight_;
+    weights.fairness  = fairness_weight_;
+    weights.robust    = robust_weight_;
+    return weights;
   };
 
   //! Run simulation
@@ -88,32 +399,72 @@ namespace staff_planner
 
     clock_t::time_point t0 = clock_t::now();
     // --------------------------------------------------------------------------------
+    std::vector<sampler_t> samplers = compile();
+
+    // the population is sampled from the plan before the planning
+    std::optional<plan::Plan> plan0;
+    if (population_ > 1) plan0 = plan_;
+
     // create state
-    planner_state_t state{samplers_, week_, plan_};
+    planner_state_t state{samplers, week_, plan_};
 
     // calibrate energy weights
-    state.calibrate(comfort_weight_);
+    state.calibrate(weights());
+    state.setRepairSize(repair_n_);
 
     // create annealer
     // TBD: IMPROVE HOW NOVER IS COMPUTED
     unsigned int nover = 10 * NOVER * static_cast<uint>(samplers_.size());
 
     anneal::Anneal<planner_state_t> anneal{nover, state};
+    anneal.setColdPhase(cold_);
 
-    // calibrate temperature
-    double ti = anneal.calibrateTi();
-    double tf = anneal.calibrateTf();
+    // calibrate temperature (the local search engines need none)
+    double ti = 0.0;
+    double tf = 0.0;
+    if (engine_ == "anneal" || population_ > 1)
+      {
+        ti = anneal.calibrateTi();
+        tf = anneal.calibrateTf();
+      }
 
     double e0_tot = state.energy();
     double e0_stf = state.staffing_energy();
     double e0_cmf = state.comfort_energy();
+    double e0_dev = state.deviation_energy();
+    double e0_ctr = state.contract_energy();
+    double e0_frn = state.fairness_energy();
+    double e0_rob = state.robust_energy();
 
-    // anneal
-    anneal.anneal(ti, tf, temp_sched_);
+    // anneal or evolve a population of plans
+    std::unique_ptr<planner_state_t> evolved;
+    if (population_ > 1)
+      {
+        Evolution<planner_state_t> evolution{samplers, week_, *plan0, state.weights(), population_, nover};
+        evolution.evolve(ti, tf, generations_);
+
+        plan_   = evolution.best();
+        evolved = std::make_unique<planner_state_t>(samplers, week_, plan_, false);
+        evolved->setWeights(state.weights());
+      }
+    else if (engine_ == "lahc")
+      local_search::Search<planner_state_t, local_search::late_acceptance>{nover, state, {parameter_ > 0 ? static_cast<uint>(parameter_) : LAHC_LENGTH}}.search(passes_);
+    else if (engine_ == "threshold")
+      local_search::Search<planner_state_t, local_search::threshold_accepting>{nover, state, {parameter_ > 0 ? parameter_ : THRESHOLD_RATIO}}.search(passes_);
+    else if (engine_ == "rrt")
+      local_search::Search<planner_state_t, local_search::record_to_record>{nover, state, {parameter_ > 0 ? parameter_ : RECORD_RATIO}}.search(passes_);
+    else
+      anneal.anneal(ti, tf, temp_sched_);
 
-    double e1_tot = state.energy();
-    double e1_stf = state.staffing_energy();
-    double e1_cmf = state.comfort_energy();
+    const planner_state_t &result = evolved ? *evolved : state;
+
+    double e1_tot = result.energy();
+    double e1_stf = result.staffing_energy();
+    double e1_cmf = result.comfort_energy();
+    double e1_dev = result.deviation_energy();
+    double e1_ctr = result.contract_energy();
+    double e1_frn = result.fairness_energy();
+    double e1_rob = result.robust_energy();
 
     // --------------------------------------------------------------------------------
     clock_t::time_point t1 = clock_t::now();
@@ -132,14 +483,30 @@ namespace staff_planner
       << "      simulated staffing: " << std::fixed << std::setprecision(2) << plan_.hours_week(week_).staffing << " hrs\n"
       << "\n"
       << "   comfort energy weight: " << std::setprecision(5) << comfort_weight_ << "\n"
+      << " deviation energy weight: " << std::setprecision(5) << deviation_weight_ << "\n"
+      << "  contract energy weight: " << std::setprecision(5) << contract_weight_ << "\n"
+      << "  fairness energy weight: " << std::setprecision(5) << fairness_weight_ << "\n"
+      << "    robust energy weight: " << std::setprecision(5) << robust_weight_ << " (" << plan_.scenarios_.size() << " scenarios)\n"
       << "\n"
-      << "         annealing steps: " << static_cast<uint>(round((log(tf) - log(ti)) / log(temp_sched_))) << "\n"
+      << "           repair agents: " << repair_n_ << "\n"
+      << "              cold phase: " << std::setprecision(5) << cold_ << "\n"
+      << "           lazy samplers: " << (lazy_ ? "yes (warm-up " + std::to_string(warmup_) + ")" : "no") << "\n"
+      << "           shift weights: " << (shift_weights_.empty() ? "no" : std::to_string(shift_weights_.size()) + " shifts") << "\n"
+      << "                  engine: " << engine_ << (passes_ > 0 ? " (" + std::to_string(passes_) + " passes)" : "") << "\n"
+      << "         annealing steps: " << (ti > 0.0 ? static_cast<uint>(round((log(tf) - log(ti)) / log(temp_sched_))) : 0) << "\n"
       << "       temperature range: " << std::fixed << std::setprecision(5) << ti << " -> " << std::fixed << std::setprecision(5) << tf << "\n"
       << "    temperature schedule: " << std::fixed << std::setprecision(2) << temp_sched_ << "\n"
+      << "            minimum rest: " << min_rest_ << " minutes\n"
+      << "              population: " << population_ << " plans x " << generations_ << " generations\n"
       << "       optimization time: " << std::fixed << std::setprecision(1) << (elapsed / 60) << " minutes\n"
+      << "          staffing drift: " << std::scientific << std::setprecision(2) << plan_.staffingDrift() << "\n"
       << "\n"
       << "         staffing energy: " << std::fixed << std::setprecision(5) << e0_stf << " -> " << std::fixed << std::setprecision(5) << e1_stf << "\n"
       << "          comfort energy: " << std::fixed << std::setprecision(5) << e0_cmf << " -> " << std::fixed << std::setprecision(5) << e1_cmf << "\n"
+      << "        deviation energy: " << std::fixed << std::setprecision(5) << e0_dev << " -> " << std::fixed << std::setprecision(5) << e1_dev << "\n"
+      << "         contract energy: " << std::fixed << std::setprecision(5) << e0_ctr << " -> " << std::fixed << std::setprecision(5) << e1_ctr << "\n"
+      << "         fairness energy: " << std::fixed << std::setprecision(5) << e0_frn << " -> " << std::fixed << std::setprecision(5) << e1_frn << "\n"
+      << "           robust energy: " << std::fixed << std::setprecision(5) << e0_rob << " -> " << std::fixed << std::setprecision(5) << e1_rob << "\n"
       << "            TOTAL ENERGY: " << std::fixed << std::setprecision(5) << e0_tot << " -> " << std::fixed << std::setprecision(5) << e1_tot << "\n"
       << "\n"
       << "     day by day staffing:\n";
@@ -179,6 +546,286 @@ namespace staff_planner
     report_ = ss.str();
   };
 
+  //! Sweep the comfort energy weight
+  /*! The samplers are compiled and the energy weights and temperatures
+   *  are calibrated once (the comfort weight calibration ratio does not
+   *  depend on the weight). The sorted weights are split in contiguous
+   *  chains run in parallel (at most one per thread, each one of at
+   *  least SWEEP_CHAIN points), in each chain the first point is
+   *  annealed from scratch while the others start from the previous
+   *  point plan and are annealed from the geometric mean of the
+   *  temperatures.
+   *
+   *  Return the non dominated (staffing energy, comfort energy) points
+   *  sorted by comfort weight, the planner plan is left untouched.
+   */
+  std::vector<sweep_point_t> StaffPlanner::sweep(const std::vector<double> &comfort_weights) const
+  {
+    using planner_state_t = State<staffing_energy, comfort_energy>;
+    using clock_t         = std::chrono::high_resolution_clock;
+    using msec_t          = std::chrono::milliseconds;
+
+    if (comfort_weights.empty()) throw std::invalid_argument{"you must provide some comfort weights"};
+    for (double w : comfort_weights)
+      if (w < 0.0) throw std::invalid_argument{"comfort energy weight must be positive"};
+
+    std::vector<double> cw{comfort_weights};
+    std::sort(cw.begin(), cw.end());
+
+    std::vector<sampler_t> samplers = compile();
+    unsigned int           nover    = 10 * NOVER * static_cast<uint>(samplers_.size());
+
+    // calibrate the weights with a unit comfort weight and the temperatures
+    energy_weights_t ratio = weights();
+    ratio.comfort          = 1.0;
+
+    double ti = 0.0;
+    double tf = 0.0;
+    {
+      plan::Plan      plan{plan_};
+      planner_state_t state{samplers, week_, plan};
+      state.calibrate(ratio);
+      ratio = state.weights();
+
+      anneal::Anneal<planner_state_t> anneal{nover, state};
+      ti = anneal.calibrateTi();
+      tf = anneal.calibrateTf();
+    }
+
+    std::mt19937_64       rne{std::random_device{}()};
+    std::vector<uint64_t> seeds(cw.size());
+    for (auto &s : seeds) s = rne();
+
+    const size_t                              n       = cw.size();
+    const size_t                              threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), std::max<size_t>(1, n / SWEEP_CHAIN));
+    std::vector<std::optional<sweep_point_t>> points(n);
+
+    auto block = [&](size_t b) {
+      plan::worker_scope scope;
+      plan::Plan         plan{plan_};
+      for (size_t i = b * n / threads; i < (b + 1) * n / threads; i++)
+        {
+          clock_t::time_point t0   = clock_t::now();
+          bool                warm = i > b * n / threads;
+
+          energy_weights_t w = ratio;
+          w.comfort          = cw[i] * ratio.comfort;
+
+          planner_state_t state{samplers, week_, plan, !warm, seeds[i]};
+          state.setWeights(w);
+          state.setRepairSize(repair_n_);
+
+          anneal::Anneal<planner_state_t> anneal{nover, state};
+          anneal.anneal(warm ? sqrt(ti * tf) : ti, tf, temp_sched_);
+
+          double seconds = std::chrono::duration_cast<msec_t>(clock_t::now() - t0).count() / 1000.0;
+          points[i]      = sweep_point_t{cw[i], state.staffing_energy(), state.comfort_energy(), seconds, plan};
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t b = 1; b < threads; b++)
+      pool.emplace_back(block, b);
+    block(0);
+    for (auto &t : pool)
+      t.join();
+
+    // keep the non dominated points
+    auto dominates = [](const sweep_point_t &q, const sweep_point_t &p) {
+      return q.staffing_energy <= p.staffing_energy && q.comfort_energy <= p.comfort_energy &&
+             (q.staffing_energy < p.staffing_energy || q.comfort_energy < p.comfort_energy);
+    };
+
+    std::vector<sweep_point_t> pareto;
+    for (const auto &p : points)
+      if (std::none_of(points.begin(), points.end(), [&](const auto &q) { return dominates(*q, *p); }))
+        pareto.push_back(*p);
+    return pareto;
+  };
+
+  //! Minimum headcount for each agents class
+  /*! The plan with all the agents is annealed first, then the classes
+   *  are sized one at a time (coordinate search) keeping the others
+   *  fixed. For each class the headcount interval (infeasible, feasible]
+   *  is narrowed by k-section: one probe for each thread evenly spaced
+   *  in the interval, all probes run in parallel.
+   *
+   *  A probe starts from the smallest feasible plan found so far with
+   *  the extra agents resting and is annealed from the geometric mean
+   *  of the calibrated temperatures. The annealing budget grows as the
+   *  interval narrows (a quarter of it for the widest intervals).
+   */
+  std::map<std::string, unsigned int> StaffPlanner::sizing(const std::vector<std::string> &agents, const std::vector<std::string> &classes, double threshold)
+  {
+    using planner_state_t = State<staffing_energy, comfort_energy>;
+    using clock_t         = std::chrono::high_resolution_clock;
+    using msec_t          = std::chrono::milliseconds;
+
+    if (threshold <= 0.0 || threshold > 1.0) throw std::invalid_argument{"invalid coverage threshold (must be between 0 and 1)"};
+    if (agents.size() != classes.size()) throw std::invalid_argument{"agents and classes must have the same length"};
+
+    // agents indices of each class
+    std::map<std::string, std::vector<unsigned int>> members;
+    std::vector<bool>                                classified(samplers_.size(), false);
+    for (size_t j = 0; j < agents.size(); j++)
+      {
+        unsigned int i = plan_.getAgentIndex(agents[j]);
+        if (classified[i]) throw std::invalid_argument{"agent " + agents[j] + " listed more than once"};
+        classified[i] = true;
+        members[classes[j]].push_back(i);
+      }
+
+    clock_t::time_point t0 = clock_t::now();
+
+    std::vector<sampler_t> samplers = compile();
+    unsigned int           nover    = 10 * NOVER * static_cast<uint>(samplers_.size());
+
+    // plan with all the agents
+    plan::Plan       best{plan_};
+    energy_weights_t weights;
+    double           ti = 0.0;
+    double           tf = 0.0;
+    {
+      planner_state_t state{samplers, week_, best};
+      state.calibrate(this->weights());
+      state.setRepairSize(repair_n_);
+      weights = state.weights();
+
+      anneal::Anneal<planner_state_t> anneal{nover, state};
+      ti = anneal.calibrateTi();
+      tf = anneal.calibrateTf();
+      anneal.anneal(ti, tf, temp_sched_);
+    }
+
+    std::stringstream ss;
+    ss
+      << "===========================================================================\n"
+      << description_ << "\n"
+      << "                 week n°: " << week_ << "\n"
+      << "      coverage threshold: " << std::fixed << std::setprecision(2) << 100 * threshold << "%\n"
+      << "     all agents coverage: " << std::fixed << std::setprecision(2) << 100 * best.coverage(week_) << "%\n"
+      << "\n"
+      << "                  probes:\n";
+
+    std::map<std::string, unsigned int> headcount;
+    for (const auto &m : members)
+      headcount[m.first] = m.second.size();
+
+    if (best.coverage(week_) < threshold)
+      {
+        ss << "  threshold not reached with all the agents\n";
+        report_ = ss.str();
+        plan_   = best;
+        return headcount;
+      }
+
+    std::mt19937_64   rne{std::random_device{}()};
+    std::vector<bool> active(samplers_.size(), true);
+    const size_t      threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (const auto &m : members)
+      {
+        const auto &idx = m.second;
+        int         lo  = -1;
+        int         hi  = static_cast<int>(idx.size());
+
+        while (hi - lo > 1)
+          {
+            // probes evenly spaced in (lo, hi)
+            std::vector<int> ks;
+            for (size_t j = 1; j <= threads; j++)
+              {
+                int k = lo + static_cast<int>(j * (hi - lo) / (threads + 1));
+                if (k > lo && k < hi && (ks.empty() || k != ks.back())) ks.push_back(k);
+              }
+            if (ks.empty()) ks.push_back(lo + 1);
+
+            double       budget = std::max(0.25, 1.0 - static_cast<double>(hi - lo) / (idx.size() + 1));
+            unsigned int n      = std::max(1u, static_cast<uint>(budget * nover));
+
+            struct probe_t
+            {
+              std::optional<plan::Plan> plan;
+              std::vector<bool>         active;
+              double                    coverage = 0.0;
+              double                    seconds  = 0.0;
+              uint64_t                  seed     = 0;
+            };
+            std::vector<probe_t> probes(ks.size());
+            for (auto &p : probes)
+              p.seed = rne();
+
+            auto probe = [&](size_t j) {
+              plan::worker_scope  scope;
+              clock_t::time_point tp0 = clock_t::now();
+
+              probe_t &p = probes[j];
+              p.plan     = best;
+              p.active   = active;
+              for (size_t a = ks[j]; a < idx.size(); a++)
+                p.active[idx[a]] = false;
+
+              planner_state_t state{samplers, week_, *p.plan, false, p.seed};
+              state.setWeights(weights);
+              state.setRepairSize(repair_n_);
+              state.setActive(p.active);
+
+              anneal::Anneal<planner_state_t> anneal{n, state};
+              anneal.anneal(sqrt(ti * tf), tf, temp_sched_);
+
+              p.coverage = p.plan->coverage(week_);
+              p.seconds  = std::chrono::duration_cast<msec_t>(clock_t::now() - tp0).count() / 1000.0;
+            };
+
+            std::vector<std::thread> pool;
+            for (size_t j = 1; j < ks.size(); j++)
+              pool.emplace_back(probe, j);
+            probe(0);
+            for (auto &t : pool)
+              t.join();
+
+            // the smallest feasible probe becomes the new upper bound
+            int new_hi = hi;
+            for (size_t j = 0; j < ks.size(); j++)
+              {
+                ss
+                  << "  " << std::setw(22) << m.first << ": "
+                  << std::setw(4) << ks[j] << " agents"
+                  << " coverage " << std::fixed << std::setprecision(2) << 100 * probes[j].coverage << "%"
+                  << " (" << std::fixed << std::setprecision(1) << probes[j].seconds << " s)\n";
+                if (probes[j].coverage >= threshold && ks[j] < new_hi)
+                  {
+                    new_hi = ks[j];
+                    best   = *probes[j].plan;
+                    active = probes[j].active;
+                  }
+              }
+            for (size_t j = 0; j < ks.size(); j++)
+              if (probes[j].coverage < threshold && ks[j] < new_hi && ks[j] > lo) lo = ks[j];
+            hi = new_hi;
+          }
+
+        headcount[m.first] = hi;
+      }
+
+    double elapsed = std::chrono::duration_cast<msec_t>(clock_t::now() - t0).count() / 1000.0;
+
+    ss
+      << "\n"
+      << "               headcount:\n";
+    for (const auto &h : headcount)
+      ss << "  " << std::setw(22) << h.first << ": " << h.second << " of " << members[h.first].size() << " agents\n";
+    ss
+      << "\n"
+      << "          sized coverage: " << std::fixed << std::setprecision(2) << 100 * best.coverage(week_) << "%\n"
+      << "       optimization time: " << std::fixed << std::setprecision(1) << (elapsed / 60) << " minutes\n"
+      << "---------------------------------------------------------------------------\n";
+
+    plan_   = best;
+    report_ = ss.str();
+    return headcount;
+  };
+
   //! Retrieve the optimized plan
   plan::Plan StaffPlanner::getPlan() const
   {
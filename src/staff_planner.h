@@ -1,5 +1,7 @@
 #pragma once
 
+#include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -14,6 +16,28 @@
 
 namespace staff_planner
 {
+  //! A point of the comfort energy weight sweep
+  struct sweep_point_t
+  {
+    double     comfort_weight;
+    double     staffing_energy;
+    double     comfort_energy;
+    double     seconds;
+    plan::Plan plan;
+  };
+
+  //! Compilation of an agents rule into a sampler
+  struct rule_stat_t
+  {
+    std::string  rule;
+    std::string  backend;
+    bool         precompiled;
+    unsigned int agents;
+    unsigned int states;
+    unsigned int transitions;
+    double       seconds;
+  };
+
   //! Staff planning process
   /*! The staff planner class takes:
    *
@@ -50,6 +74,81 @@ namespace staff_planner
     //! Set week to plan
     void setWeek(int week);
 
+    //! Set deviation energy weight (relative to staffing energy)
+    void setDeviationWeight(double deviation_weight);
+
+    //! Set contract hours energy weight (relative to staffing energy)
+    void setContractWeight(double contract_weight);
+
+    //! Set fairness energy weight (relative to staffing energy)
+    void setFairnessWeight(double fairness_weight);
+
+    //! Set robust energy weight (relative to staffing energy)
+    /*! The robust energy is the mean plus lambda times the standard
+     *  deviation of the staffing energy over the target demand
+     *  scenarios.
+     */
+    void setRobustWeight(double robust_weight);
+
+    //! Set minimum rest between shifts on consecutive days (in minutes)
+    /*! The constraint is compiled into the agents samplers when the
+     *  planning is run.
+     */
+    void setMinimumRest(int minutes);
+
+    //! Set the evolutionary mode
+    /*! When the population size is at least 2 the annealing is
+     *  replaced by a population based search over plans with line
+     *  crossover (0 disables it).
+     */
+    void setEvolution(int population, int generations);
+
+    //! Set the optimization engine
+    /*! Engines are:
+     *
+     *  - anneal:    simulated annealing (default)
+     *  - lahc:      late acceptance hill climbing (parameter: history length)
+     *  - threshold: threshold accepting (parameter: initial threshold over energy)
+     *  - rrt:       record-to-record travel (parameter: deviation over record)
+     *
+     *  the local search engines run for some passes and need no
+     *  temperature calibration, a non positive parameter selects the
+     *  default value.
+     */
+    void setEngine(const std::string &engine, int passes, double parameter);
+
+    //! Set the number of agents freed by the large neighbourhood move
+    /*! After each annealing step a day is freed for that many agents
+     *  and repaired jointly (0 disables it).
+     */
+    void setRepairSize(int agents);
+
+    //! Set the rejection-free cold phase
+    /*! Once the acceptance ratio of an annealing step falls below the
+     *  threshold the annealing draws single day moves with probability
+     *  proportional to their acceptance (0 disables it, the deviation
+     *  and robust energies disable it too).
+     */
+    void setColdPhase(double acceptance);
+
+    //! Set the lazy samplers mode
+    /*! The states of a lazy sampler are built when the sampling first
+     *  visits them (after a warm-up of some transitions from the start)
+     *  and shared by the copies of the sampler. The minimum rest and the
+     *  availability masks need the whole automaton and build it. It
+     *  applies to the samplers set afterwards.
+     */
+    void setLazySamplers(bool lazy, int warmup);
+
+    //! Set the sampling weights of the shifts
+    /*! The samplers draw the shifts leaving a state in proportion to
+     *  their weights (the shifts not given weigh 1) instead of the
+     *  default equi-probable shift classes, an empty list restores the
+     *  default. Only the samplers alias tables are rebuilt, the weights
+     *  can be changed between runs.
+     */
+    void setShiftWeights(const std::vector<std::string> &codes, const std::vector<double> &weights);
+
     //! Set a sampler for an agent
     /*! The agent's planning is defined by a regular expression over the
      *  Shift class which is not suitable for sampling. Thus we map the
@@ -58,9 +157,46 @@ namespace staff_planner
      */
     void setAgentSampler(const std::string &agent, const regexp::RegExp<shift::Shift> &regexp);
 
+    //! Set the samplers of many agents at once
+    /*! The rules are deduplicated and the unique ones are compiled in
+     *  parallel, the agents sharing a rule get copies of its sampler
+     *  (with their own random engine seed). Each rule is compiled with
+     *  its backend (brzozowski or antimirov, the former when there are
+     *  no backends), the rules compiled ahead of time in the build (see
+     *  tools/compile_rules.py) are loaded from their tables instead. Get
+     *  for each unique rule the number of agents, the automaton size and
+     *  the compile time.
+     */
+    std::vector<rule_stat_t> setAgentSamplers(const std::vector<std::string> &agents, const std::vector<regexp::RegExp<shift::Shift>> &regexps, const std::vector<std::string> &backends);
+
+    //! Set the shifts an agent is available for on a day of the plan
+    /*! Only the shifts whose code is given can be assigned to the agent
+     *  on that day (e.g. the rest shifts for a holiday), an empty list
+     *  removes the restriction. The availability is applied as a mask
+     *  on the compiled sampler, it can be changed between runs without
+     *  rebuilding the sampler.
+     */
+    void setAgentAvailability(const std::string &agent, int day, const std::vector<std::string> &codes);
+
     //! Run simulation
     void run();
 
+    //! Sweep the comfort energy weight
+    /*! Run the planning for each comfort weight in parallel (sharing
+     *  the compiled samplers and the calibration) and return the non
+     *  dominated (staffing energy, comfort energy) plans.
+     */
+    std::vector<sweep_point_t> sweep(const std::vector<double> &comfort_weights) const;
+
+    //! Minimum headcount for each agents class
+    /*! Agents are given with their class (e.g. the contract), in each
+     *  class the first agents are kept. Find for each class the minimum
+     *  number of agents such that the weekly coverage reaches the
+     *  threshold, the sized plan becomes the planner plan and the
+     *  probes are reported.
+     */
+    std::map<std::string, unsigned int> sizing(const std::vector<std::string> &agents, const std::vector<std::string> &classes, double threshold);
+
     //! Retrieve the optimized plan
     plan::Plan getPlan() const;
 
@@ -71,11 +207,39 @@ namespace staff_planner
     void printSampler(const std::string &code) const;
 
   protected:
+    //! Samplers with the minimum rest constraint compiled in and the
+    //! availability masks of the planned week
+    std::vector<sampler_t> compile() const;
+
+    //! Energy weights (before calibration)
+    energy_weights_t weights() const;
+
     const double           temp_sched_;
     const double           comfort_weight_;
+    double                 deviation_weight_;
+    double                 contract_weight_;
+    double                 fairness_weight_;
+    double                 robust_weight_;
+    unsigned int           min_rest_;
+    unsigned int           population_;
+    unsigned int           generations_;
+    std::string            engine_;
+    unsigned int           passes_;
+    double                 parameter_;
+    unsigned int           repair_n_;
+    double                 cold_;
     unsigned int           week_;
+    bool                   lazy_;
+    unsigned int           warmup_;
     plan::Plan             plan_;
+
+    // shift code => sampling weight (default weights when empty)
+    std::map<std::string, double> shift_weights_;
+
     std::vector<sampler_t> samplers_;
+
+    // agent => day => available shift codes
+    std::vector<std::map<unsigned int, std::set<std::string>>> availability_;
     std::string            report_;
     std::string            description_;
   };
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <algorithm>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <numeric>
 #include <random>
 #include <vector>
 
@@ -14,6 +18,16 @@ namespace staff_planner
 
   using sampler_t = fsm::Fsm<shift::Shift, shift::shift_epp>;
 
+  //! Energy weights relative to the staffing energy
+  struct energy_weights_t
+  {
+    double comfort   = 0.0;
+    double deviation = 0.0;
+    double contract  = 0.0;
+    double fairness  = 0.0;
+    double robust    = 0.0;
+  };
+
   //! The planner state implements a sampler for the set of all possible plannings
   /*! The planner state consists in:
    *
@@ -42,7 +56,19 @@ namespace staff_planner
   {
   public:
     //! Takes a sampler for each agent and the target staffing curve
-    State(const std::vector<sampler_t> &samplers, unsigned int week, plan::Plan &plan)
+    /*! The agents week lines are sampled unless sample is false, in
+     *  that case the current plan lines (and staffing) are kept as the
+     *  starting state. The random engines are seeded from the random
+     *  device.
+     */
+    State(const std::vector<sampler_t> &samplers, unsigned int week, plan::Plan &plan, bool sample = true)
+      : State{samplers, week, plan, sample, device_seed()} {};
+
+    //! Takes a sampler for each agent, the target staffing curve and a seed
+    /*! The state and samplers random engines are seeded (as by seed)
+     *  before the week lines are sampled.
+     */
+    State(const std::vector<sampler_t> &samplers, unsigned int week, plan::Plan &plan, bool sample, uint64_t s)
       : rne_{}
       , samplers_{samplers}
       , week_{week}
@@ -51,21 +77,105 @@ namespace staff_planner
       , mutd_pln_{}
       , prev_stf_(plan_.weekSlots(), 0.0)
       , mutd_stf_(plan_.weekSlots(), 0.0)
-      , w1_{1.0}
+      , mutd_runs_{}
+      , prev_hrs_{0.0}
+      , mutd_hrs_{0.0}
+      , prev_brd_{0.0}
+      , mutd_brd_{0.0}
+      , brk_cost_{}
+      , w_{1.0, 0.0, 0.0, 0.0}
+      , repair_n_{0}
+      , active_(samplers.size())
+      , best_lines_(samplers.size())
+      , best_changed_{}
+      , logging_{true}
+      , move_base_{}
+      , move_width_{}
+      , move_alt_{}
+      , move_de_{}
+      , move_pw_{}
+      , move_pwe_{}
       , staffing_energy_{plan_, week_}
       , comfort_energy_{plan_, week_}
+      , deviation_energy_{plan_, week_}
+      , contract_energy_{plan_, week_}
+      , fairness_energy_{plan_, week_}
+      , robust_energy_{plan_, week_}
     {
       if (samplers_.empty()) throw std::runtime_error{"you must provide some samplers"};
 
-      std::random_device device;
-      rne_.seed((static_cast<uint64_t>(device()) << 32) | device());
+      std::iota(active_.begin(), active_.end(), 0);
+
+      seed(s);
 
+      for (unsigned int i = 0; sample && i < samplers_.size(); i++)
+        plan_.updatePlan(i, week_ * 7, samplers_[i].sample());
+      plan_.recomputeStaffing();
       for (unsigned int i = 0; i < samplers_.size(); i++)
         {
-          plan::Plan::line_t pln = samplers_[i].sample();
-          plan_.updatePlan(i, week_ * 7, pln);
-          for (unsigned int day = 0; day < pln.size(); day++)
-            pln[day].add_staff(week_ * 7 + day, +1, plan_.staffing_);
+          const auto &line = plan_.plan_[i];
+          mutd_idx_        = i;
+          mutd_pln_        = plan::Plan::line_t{line.begin() + week_ * 7, line.begin() + (week_ + 1) * 7};
+          if (std::none_of(mutd_pln_.begin(), mutd_pln_.end(), [](const shift::Shift &s) { return s.flexible(); })) continue;
+          set_mutation();
+          commit();
+        }
+      contract_energy_.reset();
+      fairness_energy_.reset();
+      robust_energy_.reset();
+      mark_best();
+      mutate();
+    };
+
+    //! Seed the state and samplers random engines
+    void seed(uint64_t s)
+    {
+      rne_.seed(s);
+      for (auto &smp : samplers_)
+        smp.seed(rne_());
+    };
+
+    //! Energy weights
+    const energy_weights_t &weights() const
+    {
+      return w_;
+    };
+
+    //! Set the energy weights (as found by calibrate)
+    void setWeights(const energy_weights_t &w)
+    {
+      set_weights(w);
+    };
+
+    //! Set the number of agents freed by the large neighbourhood move
+    void setRepairSize(unsigned int n)
+    {
+      repair_n_ = n;
+    };
+
+    //! Set the agents that can work
+    /*! Inactive agents rest all the week and are never mutated, agents
+     *  becoming active get a sampled week line.
+     */
+    void setActive(const std::vector<bool> &active)
+    {
+      if (active.size() != samplers_.size()) throw std::invalid_argument{"invalid active agents mask"};
+      if (std::none_of(active.begin(), active.end(), [](bool a) { return a; })) throw std::invalid_argument{"there must be some active agents"};
+
+      std::vector<bool> was(samplers_.size(), false);
+      for (unsigned int i : active_)
+        was[i] = true;
+
+      active_.clear();
+      for (unsigned int i = 0; i < samplers_.size(); i++)
+        {
+          if (active[i]) active_.push_back(i);
+          if (active[i] == was[i]) continue;
+
+          mutd_idx_ = i;
+          mutd_pln_ = active[i] ? samplers_[i].sample() : plan::Plan::line_t(7, shift::Shift{});
+          set_mutation();
+          apply_mutation();
         }
       mutate();
     };
@@ -73,13 +183,23 @@ namespace staff_planner
     //! Get the energy of the current state
     double energy() const
     {
-      return staffing_energy_.energy() + w1_ * comfort_energy_.energy();
+      double e = staffing_energy_.energy() + w_.comfort * comfort_energy_.energy();
+      if (w_.deviation != 0.0) e += w_.deviation * deviation_energy_.energy();
+      if (w_.contract != 0.0) e += w_.contract * contract_energy_.energy();
+      if (w_.fairness != 0.0) e += w_.fairness * fairness_energy_.energy();
+      if (w_.robust != 0.0) e += w_.robust * robust_energy_.energy();
+      return e;
     };
 
     //! Get the energy delta of the mutated state
     double delta_energy() const
     {
-      return staffing_energy_.delta(prev_stf_, mutd_stf_) + w1_ * comfort_energy_.delta(mutd_idx_, mutd_pln_);
+      double de = staffing_energy_.delta(prev_stf_, mutd_stf_) + w_.comfort * comfort_energy_.delta(mutd_idx_, mutd_pln_);
+      if (w_.deviation != 0.0) de += w_.deviation * deviation_energy_.delta(mutd_runs_);
+      if (w_.contract != 0.0) de += w_.contract * contract_energy_.delta(mutd_idx_, prev_hrs_, mutd_hrs_);
+      if (w_.fairness != 0.0) de += w_.fairness * fairness_energy_.delta(mutd_idx_, prev_brd_, mutd_brd_);
+      if (w_.robust != 0.0) de += w_.robust * robust_energy_.delta(mutd_runs_);
+      return de;
     };
 
     //! Get the staffing energy contribution
@@ -106,22 +226,71 @@ namespace staff_planner
       return comfort_energy_.delta(mutd_idx_, mutd_pln_);
     };
 
+    //! Get the deviation energy contribution
+    /*! The error trees are kept only while the term is weighed, they
+     *  are rebuilt first otherwise.
+     */
+    double deviation_energy() const
+    {
+      if (w_.deviation == 0.0) plan_.resetErrors();
+      return deviation_energy_.energy();
+    };
+
+    //! Get the contract energy contribution
+    double contract_energy() const
+    {
+      return contract_energy_.energy();
+    };
+
+    //! Get the fairness energy contribution
+    double fairness_energy() const
+    {
+      return fairness_energy_.energy();
+    };
+
+    //! Get the robust energy contribution
+    double robust_energy() const
+    {
+      return robust_energy_.energy();
+    };
+
     //! Calibrate energy weights
-    void calibrate(double w1)
+    /*! Each weight is rescaled by the ratio between the mean staffing
+     *  energy and the mean energy of its term over a random walk.
+     */
+    void calibrate(const energy_weights_t &w)
     {
-      if (w1 == 0.0)
-        {
-          w1_ = 0.0;
-          return;
-        }
+      set_weights(w);
+
+      // terms with a non zero weight: name, calibrated weight, energy
+      struct term_t
+      {
+        std::string             name;
+        double *                weight;
+        std::function<double()> energy;
+        double                  sum;
+        double                  sum_sq;
+      };
+      std::vector<term_t> terms;
+      if (w.comfort != 0.0)
+        terms.push_back(term_t{"comfort", &w_.comfort, [&]() { return comfort_energy_.energy(); }, 0.0, 0.0});
+      if (w.deviation != 0.0)
+        terms.push_back(term_t{"deviation", &w_.deviation, [&]() { return deviation_energy_.energy(); }, 0.0, 0.0});
+      if (w.contract != 0.0)
+        terms.push_back(term_t{"contract", &w_.contract, [&]() { return contract_energy_.energy(); }, 0.0, 0.0});
+      if (w.fairness != 0.0)
+        terms.push_back(term_t{"fairness", &w_.fairness, [&]() { return fairness_energy_.energy(); }, 0.0, 0.0});
+      if (w.robust != 0.0)
+        terms.push_back(term_t{"robust", &w_.robust, [&]() { return robust_energy_.energy(); }, 0.0, 0.0});
+
+      if (terms.empty())
+        return;
       unsigned int n = 200000;
 
       std::cout << "calibrating energy weights (" << n << " iterations)\n" << std::flush;
 
       double sum0    = 0.0;
       double sum_sq0 = 0.0;
-      double sum1    = 0.0;
-      double sum_sq1 = 0.0;
 
       for (unsigned int i = 1; i < n; i++)
         {
@@ -132,27 +301,37 @@ namespace staff_planner
           sum0 += e0;
           sum_sq0 += e0 * e0;
 
-          double e1 = comfort_energy_.energy();
-          sum1 += e1;
-          sum_sq1 += e1 * e1;
+          for (auto &t : terms)
+            {
+              double e = t.energy();
+              t.sum += e;
+              t.sum_sq += e * e;
+            }
         }
 
       double mean0   = sum0 / n;
       double stddev0 = sqrt((sum_sq0 - sum0 * sum0 / n) / (n - 1));
 
-      double mean1   = sum1 / n;
-      double stddev1 = sqrt((sum_sq1 - sum1 * sum1 / n) / (n - 1));
-
       std::cout
-        << "staffing energy: mean=" << std::setprecision(4) << mean0 << " stddev=" << std::setprecision(4) << stddev0
-        << "\n"
-        << " comfort energy: mean=" << std::setprecision(4) << mean1 << " stddev=" << std::setprecision(4) << stddev1
+        << std::setw(9) << "staffing" << " energy: mean=" << std::setprecision(4) << mean0 << " stddev=" << std::setprecision(4) << stddev0
         << "\n"
         << std::flush;
 
-      w1_ = w1 * mean0 / mean1;
+      for (const auto &t : terms)
+        {
+          double mean   = t.sum / n;
+          double stddev = sqrt((t.sum_sq - t.sum * t.sum / n) / (n - 1));
+          double w0     = *t.weight;
+
+          std::cout
+            << std::setw(9) << t.name << " energy: mean=" << std::setprecision(4) << mean << " stddev=" << std::setprecision(4) << stddev
+            << "\n"
+            << std::flush;
 
-      std::cout << "updating ratio: " << std::setprecision(4) << w1 << " -> " << std::setprecision(4) << w1_ << "\n" << std::flush;
+          if (mean > 0.0) *t.weight = w0 * mean0 / mean;
+
+          std::cout << "   updating ratio: " << std::setprecision(4) << w0 << " -> " << std::setprecision(4) << *t.weight << "\n" << std::flush;
+        }
     };
 
     //! Mutate state by choosing one sampler and generating its plan
@@ -164,39 +343,271 @@ namespace staff_planner
      */
     void mutate()
     {
-      mutd_idx_ = dist_int_t{0, samplers_.size() - 1}(rne_);
+      mutd_idx_ = active_[dist_int_t{0, active_.size() - 1}(rne_)];
 
       if (dist_dbl_t{0.0, 1.0}(rne_) < 0.8)
         mutd_pln_ = samplers_[mutd_idx_].sample();
       else
         mutd_pln_ = samplers_[mutd_idx_].resample([&](unsigned int day, const plan::Plan::line_t &pln, const shift::Shift &sht) {
-          return staffing_energy_.fitness(week_ * 7 + day, plan_.plan_[mutd_idx_][week_ * 7 + day], sht) + w1_ * comfort_energy_.fitness(pln, plan_.plan_[mutd_idx_][week_ * 7 + day], sht);
+          return staffing_energy_.fitness(week_ * 7 + day, plan_.plan_[mutd_idx_][week_ * 7 + day], sht) + w_.comfort * comfort_energy_.fitness(pln, plan_.plan_[mutd_idx_][week_ * 7 + day], sht);
         });
       // TBD: CHECK CORRECTNESS OF FITNESS USE
 
-      for (unsigned int i    = 0; i < mutd_stf_.size(); i++)
-        prev_stf_[i] = mutd_stf_[i] = 0.0;
+      set_mutation();
+    };
 
-      for (unsigned int day = 0; day < 7; day++)
+    //! Large neighbourhood move: destroy and repair a day
+    /*! A random day of the week is freed for a random subset of agents,
+     *  each agent can take any shift allowed by its sampler with the
+     *  rest of its week line fixed. The agents are assigned greedily
+     *  against the residual staffing of the day and then improved by
+     *  rounds of best response, the staffing energy change of a shift
+     *  being the sum of w * (1 + 2 * e) over its slots.
+     *
+     *  The new shifts are applied as single agent mutations (so every
+     *  energy term stays consistent) and rolled back if the total
+     *  energy gets worse. Return the applied energy delta.
+     */
+    double repair()
+    {
+      if (repair_n_ == 0) return 0.0;
+
+      const unsigned int day = week_ * 7 + dist_int_t{0, 6}(rne_);
+
+      std::vector<unsigned int> agents{active_};
+      std::shuffle(agents.begin(), agents.end(), rne_);
+      agents.resize(std::min<size_t>(repair_n_, agents.size()));
+
+      // residual staffing error of the day (and its spill) without the freed agents
+      const unsigned int slot0 = day * SLOTS_DAY;
+      const unsigned int slot1 = std::min<size_t>(slot0 + 2 * SLOTS_DAY, std::min(plan_.staffing_.size(), plan_.target_.size()));
+
+      std::vector<double> res(slot1 - slot0, 0.0);
+      for (unsigned int i = slot0; i < slot1; i++)
+        res[i - slot0] = plan_.staffing_[i] - plan_.target_[i];
+
+      std::vector<std::vector<shift::Shift>> cand(agents.size());
+      for (size_t j = 0; j < agents.size(); j++)
         {
-          plan_.plan_[mutd_idx_][week_ * 7 + day].add_staff(day, +1, prev_stf_);
-          mutd_pln_[day].add_staff(day, +1, mutd_stf_);
+          const auto &line = plan_.plan_[agents[j]];
+          cand[j]          = samplers_[agents[j]].alternatives(plan::Plan::line_t{line.begin() + week_ * 7, line.begin() + (week_ + 1) * 7}, day - week_ * 7);
+          if (cand[j].empty()) cand[j].push_back(line[day]);
+          line[day].add_staff(0, -1, res);
+        }
+
+      auto cost = [&](const shift::Shift &sht) {
+        double c = 0.0;
+        for (const auto &s : sht.span())
+          for (unsigned int i = s.first / SLOT_LENGTH; i < s.second / SLOT_LENGTH && i < res.size(); i++)
+            c += plan_.weights_[slot0 + i] * (1.0 + 2.0 * res[i]);
+        return c;
+      };
+      auto best = [&](size_t j) {
+        size_t k = 0;
+        double c = cost(cand[j][0]);
+        for (size_t h = 1; h < cand[j].size(); h++)
+          {
+            double ch = cost(cand[j][h]);
+            if (ch < c)
+              {
+                c = ch;
+                k = h;
+              }
+          }
+        return k;
+      };
+
+      // greedy assignment and best response rounds
+      std::vector<size_t> choice(agents.size());
+      for (size_t j = 0; j < agents.size(); j++)
+        {
+          choice[j] = best(j);
+          cand[j][choice[j]].add_staff(0, +1, res);
         }
+      for (unsigned int round = 0; round < REPAIR_ROUNDS; round++)
+        {
+          bool changed = false;
+          for (size_t j = 0; j < agents.size(); j++)
+            {
+              cand[j][choice[j]].add_staff(0, -1, res);
+              size_t k = best(j);
+              cand[j][k].add_staff(0, +1, res);
+              changed   = changed || k != choice[j];
+              choice[j] = k;
+            }
+          if (!changed) break;
+        }
+
+      // apply the new shifts as single agent mutations
+      double                                                   de = 0.0;
+      std::vector<std::pair<unsigned int, plan::Plan::line_t>> undo;
+      for (size_t j = 0; j < agents.size(); j++)
+        {
+          const auto &line = plan_.plan_[agents[j]];
+          if (cand[j][choice[j]] == line[day]) continue;
+
+          undo.emplace_back(agents[j], plan::Plan::line_t{line.begin() + week_ * 7, line.begin() + (week_ + 1) * 7});
+          mutd_idx_                  = agents[j];
+          mutd_pln_                  = undo.back().second;
+          mutd_pln_[day - week_ * 7] = cand[j][choice[j]];
+          set_mutation();
+          de += delta_energy();
+          apply_mutation();
+        }
+
+      if (de > 0.0)
+        {
+          for (auto u = undo.rbegin(); u != undo.rend(); ++u)
+            {
+              mutd_idx_ = u->first;
+              mutd_pln_ = u->second;
+              set_mutation(false);
+              commit();
+            }
+          de = 0.0;
+        }
+      return de;
     };
 
     //! Apply mutation to state and staffing
+    /*! The flexible breaks of the mutated line are already placed, so
+     *  the applied change is the one evaluated by delta_energy.
+     */
     void apply_mutation()
     {
-      plan_.updatePlan(mutd_idx_, week_ * 7, mutd_pln_);
+      commit();
+    };
 
-      for (unsigned int i = 0; i < plan_.weekSlots(); i++)
-        plan_.staffing_[week_ * 7 * SLOTS_DAY + i] += mutd_stf_[i] - prev_stf_[i];
+    //! Mark the current plan as the best one
+    /*! From now on the week line of each agent is logged the first time
+     *  it is changed, so that the marked plan can be restored.
+     */
+    void mark_best()
+    {
+      for (unsigned int i : best_changed_)
+        best_lines_[i].clear();
+      best_changed_.clear();
+    };
+
+    //! Restore the plan marked as the best one
+    /*! The logged lines are applied back as they were (their breaks are
+     *  not placed again), then the restored plan is marked.
+     */
+    void restore_best()
+    {
+      logging_ = false;
+      for (unsigned int i : best_changed_)
+        {
+          mutd_idx_ = i;
+          mutd_pln_ = best_lines_[i];
+          set_mutation(false);
+          commit();
+        }
+      logging_ = true;
+      mark_best();
+      mutate();
+    };
+
+    //! Check whether the single day moves can be indexed
+    /*! The deviation and robust terms depend on the whole staffing
+     *  curve, their deltas cannot be kept per move.
+     */
+    bool indexable() const
+    {
+      return w_.deviation == 0.0 && w_.robust == 0.0;
+    };
+
+    //! Index the single day moves of the active agents
+    /*! A move replaces the shift of an agent on a day of the week with
+     *  another shift accepted by its sampler (the rest of the line
+     *  fixed). The moves of agent a on day d are stored in the slots
+     *  base_a + d * width_a + k where width_a is the size of the agent
+     *  sampler alphabet, the energy delta of each move is kept (with
+     *  the staffing and comfort energies semantics) and it is infinite
+     *  for the empty slots, for the current shifts and for the shifts
+     *  with flexible breaks (their placement depends on the residual
+     *  staffing, they are left to the Metropolis moves). Return the
+     *  number of slots.
+     */
+    size_t index_moves()
+    {
+      move_base_.assign(samplers_.size() + 1, 0);
+      move_width_.assign(samplers_.size(), 0);
+      move_alt_.assign(samplers_.size() * 7, {});
+
+      std::vector<bool> active(samplers_.size(), false);
+      for (unsigned int i : active_)
+        active[i] = true;
+      for (unsigned int i = 0; i < samplers_.size(); i++)
+        {
+          move_width_[i]    = active[i] ? samplers_[i].letters() : 0;
+          move_base_[i + 1] = move_base_[i] + 7 * move_width_[i];
+        }
+      move_de_.assign(move_base_.back(), std::numeric_limits<double>::infinity());
+
+      index_staffing();
+      for (unsigned int i : active_)
+        for (unsigned int day = 0; day < 7; day++)
+          index_alternatives(i, day, nullptr);
+      return move_de_.size();
+    };
+
+    //! Energy delta of an indexed move
+    double move_delta(size_t m) const
+    {
+      return move_de_[m];
+    };
+
+    //! Apply an indexed move
+    /*! The deltas of the moves affected by the change are refreshed and
+     *  their slots appended to changed: the moves of the agent, the
+     *  moves of all agents on the days whose staffing changed (and the
+     *  days before them, their shifts spill over) and, if the burden of
+     *  the agent changed, the moves of its team.
+     */
+    void apply_move(size_t m, std::vector<size_t> &changed)
+    {
+      const unsigned int idx  = std::upper_bound(move_base_.begin(), move_base_.end(), m) - move_base_.begin() - 1;
+      const unsigned int day  = (m - move_base_[idx]) / move_width_[idx];
+      const unsigned int k    = (m - move_base_[idx]) % move_width_[idx];
+      const auto &       line = plan_.plan_[idx];
+
+      plan::Plan::line_t prev{line.begin() + week_ * 7, line.begin() + (week_ + 1) * 7};
+      mutd_idx_      = idx;
+      mutd_pln_      = prev;
+      mutd_pln_[day] = samplers_[idx].letter(move_alt_[idx * 7 + day][k]);
+      set_mutation(false);
+      bool burden = prev_brd_ != mutd_brd_;
+      apply_mutation();
+
+      // days whose staffing changed (the new shift has no flexible breaks)
+      std::vector<bool> days(7, false);
+      for (unsigned int d = day > 0 ? day - 1 : 0; d <= day + 1 && d < 7; d++)
+        days[d] = true;
+
+      index_staffing();
+      for (unsigned int d = 0; d < 7; d++)
+        index_alternatives(idx, d, &changed);
+      for (unsigned int i : active_)
+        {
+          if (i == idx) continue;
+          bool team = burden && w_.fairness != 0.0 && plan_.agent_team_[i] == plan_.agent_team_[idx];
+          for (unsigned int d = 0; d < 7; d++)
+            if (team || days[d]) index_deltas(i, d, &changed);
+        }
+      mutate();
     };
 
   private:
     using dist_int_t = std::uniform_int_distribution<size_t>;
     using dist_dbl_t = std::uniform_real_distribution<double>;
 
+    static uint64_t device_seed()
+    {
+      std::random_device device;
+      return (static_cast<uint64_t>(device()) << 32) | device();
+    };
+
     std::mt19937_64 rne_;
 
     // state setup
@@ -210,12 +621,237 @@ namespace staff_planner
     std::vector<double> prev_stf_;
     std::vector<double> mutd_stf_;
 
-    // comfort energy weight
-    double w1_;
+    // runs of constant staffing change (absolute slots)
+    std::vector<plan::staffing_run_t> mutd_runs_;
+
+    // worked hours of the current and mutated week lines
+    double prev_hrs_;
+    double mutd_hrs_;
+
+    // burden of the current and mutated week lines
+    double prev_brd_;
+    double mutd_brd_;
+
+    // flexible break slot costs
+    std::vector<double> brk_cost_;
+
+    // energy weights
+    energy_weights_t w_;
+
+    // agents freed by the large neighbourhood move
+    unsigned int repair_n_;
+
+    // agents that can work
+    std::vector<unsigned int> active_;
+
+    // week lines of the best plan for the agents changed since it was marked
+    std::vector<plan::Plan::line_t> best_lines_;
+    std::vector<unsigned int>       best_changed_;
+    bool                            logging_;
+
+    // indexed single day moves: slots of each agent, alternatives (sampler
+    // letters) for each agent day, energy deltas and the week prefix sums
+    // of w and w * (staffing - target)
+    std::vector<size_t>              move_base_;
+    std::vector<size_t>              move_width_;
+    std::vector<std::vector<size_t>> move_alt_;
+    std::vector<double>              move_de_;
+    std::vector<double>              move_pw_;
+    std::vector<double>              move_pwe_;
+
+    // week prefix sums for the indexed moves
+    void index_staffing()
+    {
+      const unsigned int slot0 = week_ * 7 * SLOTS_DAY;
+      const unsigned int n     = plan_.weekSlots();
+      move_pw_.assign(n + 1, 0.0);
+      move_pwe_.assign(n + 1, 0.0);
+      for (unsigned int i = 0; i < n; i++)
+        {
+          move_pw_[i + 1]  = move_pw_[i] + plan_.weights_[slot0 + i];
+          move_pwe_[i + 1] = move_pwe_[i] + plan_.weights_[slot0 + i] * (plan_.staffing_[slot0 + i] - plan_.target_[slot0 + i]);
+        }
+    };
+
+    // alternatives and deltas of the moves of an agent day
+    void index_alternatives(unsigned int idx, unsigned int day, std::vector<size_t> *changed)
+    {
+      const auto &line          = plan_.plan_[idx];
+      move_alt_[idx * 7 + day] = samplers_[idx].alternative_letters(plan::Plan::line_t{line.begin() + week_ * 7, line.begin() + (week_ + 1) * 7}, day);
+      index_deltas(idx, day, changed);
+    };
+
+    // energy deltas of the moves of an agent day, a move changes the
+    // staffing by +1 over the new shift s1 and -1 over the current
+    // shift s0, so that n * dE = Sum_s1 w (1 + 2e) + Sum_s0 w (1 - 2e) - 2 Sum_s0&s1 w
+    void index_deltas(unsigned int idx, unsigned int day, std::vector<size_t> *changed)
+    {
+      const double       inf   = std::numeric_limits<double>::infinity();
+      const unsigned int n     = plan_.weekSlots();
+      const unsigned int d0    = week_ * 7 + day;
+      const size_t       base  = move_base_[idx] + day * move_width_[idx];
+      const auto &       alts  = move_alt_[idx * 7 + day];
+      const auto &       line  = plan_.plan_[idx];
+      const auto &       s0    = line[d0];
+      const auto         spn0  = s0.span();
+      const double       brd0  = staff_planner::fairness_energy::burden(d0, s0);
+
+      auto slot = [&](unsigned int t) { return std::min(n, day * SLOTS_DAY + t / SLOT_LENGTH); };
+      auto sum  = [&](const std::vector<double> &p, const std::vector<shift::Shift::span_t> &spn) {
+        double s = 0.0;
+        for (const auto &sp : spn)
+          s += p[slot(sp.second)] - p[slot(sp.first)];
+        return s;
+      };
+      auto pair = [](const shift::Shift &a, const shift::Shift &b) {
+        if (!a.work() || !b.work()) return 0.0;
+        double d = (static_cast<double>(b.t0()) - static_cast<double>(a.t0())) / SLOT_LENGTH;
+        return d * d;
+      };
+      auto comfort = [&](const shift::Shift &s) {
+        double c = 0.0;
+        if (day > 0) c += pair(line[d0 - 1], s);
+        if (day < 6) c += pair(s, line[d0 + 1]);
+        return c;
+      };
+
+      const double out0 = sum(move_pw_, spn0) - 2.0 * sum(move_pwe_, spn0);
+      const double cmf0 = comfort(s0);
+
+      for (size_t k = 0; k < move_width_[idx]; k++)
+        {
+          double de = inf;
+          if (k < alts.size())
+            {
+              const auto &s1 = samplers_[idx].letter(alts[k]);
+              if (!(s1 == s0) && !s1.flexible())
+                {
+                  const auto spn1    = s1.span();
+                  double     overlap = 0.0;
+                  for (const auto &a : spn0)
+                    for (const auto &b : spn1)
+                      {
+                        unsigned int t0 = std::max(a.first, b.first);
+                        unsigned int t1 = std::min(a.second, b.second);
+                        if (t0 < t1) overlap += move_pw_[slot(t1)] - move_pw_[slot(t0)];
+                      }
+                  de = (sum(move_pw_, spn1) + 2.0 * sum(move_pwe_, spn1) + out0 - 2.0 * overlap) / n;
+                  de += w_.comfort * (comfort(s1) - cmf0) / 7;
+                  if (w_.contract != 0.0) de += w_.contract * contract_energy_.delta(idx, s0.hours(), s1.hours());
+                  if (w_.fairness != 0.0) de += w_.fairness * fairness_energy_.delta(idx, brd0, staff_planner::fairness_energy::burden(d0, s1));
+                }
+            }
+          move_de_[base + k] = de;
+          if (changed) changed->push_back(base + k);
+        }
+    };
+
+    // apply the mutated line (with its breaks as they are) to plan and staffing
+    void commit()
+    {
+      if (logging_ && best_lines_[mutd_idx_].empty())
+        {
+          const auto &line       = plan_.plan_[mutd_idx_];
+          best_lines_[mutd_idx_] = plan::Plan::line_t{line.begin() + week_ * 7, line.begin() + (week_ + 1) * 7};
+          best_changed_.push_back(mutd_idx_);
+        }
+
+      plan_.updatePlan(mutd_idx_, week_ * 7, mutd_pln_);
+
+      for (const auto &r : mutd_runs_)
+        {
+          robust_energy_.apply(r);
+          for (unsigned int i = r.slot0; i < r.slot1; i++)
+            plan_.staffing_[i] += r.delta;
+        }
+
+      if (w_.deviation != 0.0) plan_.updateErrors(mutd_runs_);
+      contract_energy_.apply(mutd_idx_, prev_hrs_, mutd_hrs_);
+      fairness_energy_.apply(mutd_idx_, prev_brd_, mutd_brd_);
+    };
+
+    // energy weights, the error trees are rebuilt when the deviation
+    // term is turned on (they are not updated while it is off)
+    void set_weights(const energy_weights_t &w)
+    {
+      if (w.deviation != 0.0 && w_.deviation == 0.0) plan_.resetErrors();
+      w_ = w;
+    };
+
+    // staffing, hours and burden changes of the mutated line, the
+    // flexible breaks of the line are placed first unless place is false
+    // (the line is applied back with its breaks as they are)
+    void set_mutation(bool place = true)
+    {
+      for (unsigned int i    = 0; i < mutd_stf_.size(); i++)
+        prev_stf_[i] = mutd_stf_[i] = 0.0;
+
+      prev_hrs_ = mutd_hrs_ = 0.0;
+      prev_brd_ = mutd_brd_ = 0.0;
+      for (unsigned int day = 0; day < 7; day++)
+        {
+          const auto &prev = plan_.plan_[mutd_idx_][week_ * 7 + day];
+          prev.add_staff(day, +1, prev_stf_);
+          mutd_pln_[day].add_staff(day, +1, mutd_stf_);
+          prev_hrs_ += prev.hours();
+          mutd_hrs_ += mutd_pln_[day].hours();
+          prev_brd_ += staff_planner::fairness_energy::burden(week_ * 7 + day, prev);
+          mutd_brd_ += staff_planner::fairness_energy::burden(week_ * 7 + day, mutd_pln_[day]);
+        }
+      for (unsigned int day = 0; place && day < 7; day++)
+        place_breaks(day);
+
+      // collect the runs of constant staffing change
+      unsigned int slot0 = week_ * 7 * SLOTS_DAY;
+      mutd_runs_.clear();
+      for (unsigned int i = 0; i < mutd_stf_.size(); i++)
+        {
+          double d = mutd_stf_[i] - prev_stf_[i];
+          if (d == 0.0) continue;
+          if (!mutd_runs_.empty() && mutd_runs_.back().slot1 == slot0 + i && mutd_runs_.back().delta == d)
+            mutd_runs_.back().slot1++;
+          else
+            mutd_runs_.emplace_back(slot0 + i, slot0 + i + 1, d);
+        }
+    };
+
+    // place the flexible breaks of the mutated line on a day against
+    // the staffing with the mutation, removing the agent from a slot
+    // changes the staffing energy by w * (1 - 2 * e) where e is the
+    // staffing error with the agent at work
+    void place_breaks(unsigned int day)
+    {
+      const shift::Shift &sht = mutd_pln_[day];
+      if (!sht.flexible()) return;
+
+      const unsigned int slot0 = week_ * 7 * SLOTS_DAY;
+      const unsigned int i0    = day * SLOTS_DAY;
+      const unsigned int i1    = std::min<size_t>(i0 + 2 * SLOTS_DAY, mutd_stf_.size());
+
+      brk_cost_.assign(i1 - i0, 0.0);
+      for (unsigned int i = i0; i < i1; i++)
+        brk_cost_[i - i0] = plan_.staffing_[slot0 + i] + mutd_stf_[i] - prev_stf_[i] - plan_.target_[slot0 + i];
+      for (const auto &b : sht.breaks())
+        for (unsigned int i = b.first / SLOT_LENGTH; i < b.second / SLOT_LENGTH && i < i1 - i0; i++)
+          brk_cost_[i] += 1.0;
+      for (unsigned int i = i0; i < i1; i++)
+        brk_cost_[i - i0] = plan_.weights_[slot0 + i] * (1.0 - 2.0 * brk_cost_[i - i0]);
+
+      shift::Shift placed = sht.place_breaks(brk_cost_);
+      if (placed.breaks() == sht.breaks()) return;
+
+      sht.add_staff(day, -1, mutd_stf_);
+      placed.add_staff(day, +1, mutd_stf_);
+      mutd_pln_[day] = placed;
+    };
 
     // energy terms
-    const ESTF staffing_energy_;
-    const ECMF comfort_energy_;
+    const ESTF                            staffing_energy_;
+    const ECMF                            comfort_energy_;
+    const staff_planner::deviation_energy deviation_energy_;
+    staff_planner::contract_energy        contract_energy_;
+    staff_planner::fairness_energy        fairness_energy_;
+    staff_planner::robust_energy          robust_energy_;
   };
 
   //! Stream output
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace sum_tree
+{
+  //! Sum tree over a vector of non negative values
+  /*! The tree supports the following operations:
+   *
+   *  - set a value in O(log n)
+   *  - total of the values in O(1)
+   *  - find the value whose cumulative range contains a point in
+   *    O(log n), that is sample an index with probability proportional
+   *    to its value
+   */
+  class SumTree
+  {
+  public:
+    SumTree()
+      : size_{0}
+      , leaves_{1}
+      , sum_(2, 0.0) {};
+
+    //! Build the tree over n zero values
+    SumTree(unsigned int n)
+      : size_{n}
+      , leaves_{1}
+      , sum_{}
+    {
+      while (leaves_ < size_)
+        leaves_ *= 2;
+      sum_.assign(2 * leaves_, 0.0);
+    };
+
+    //! Number of values
+    unsigned int size() const
+    {
+      return size_;
+    };
+
+    //! Set value at position i
+    void set(unsigned int i, double v)
+    {
+      if (i >= size_) throw std::out_of_range{"sum tree index out of range"};
+      unsigned int n = leaves_ + i;
+      double       d = v - sum_[n];
+      for (; n > 0; n /= 2)
+        sum_[n] += d;
+    };
+
+    //! Value at position i
+    double value(unsigned int i) const
+    {
+      if (i >= size_) throw std::out_of_range{"sum tree index out of range"};
+      return sum_[leaves_ + i];
+    };
+
+    //! Sum of the values
+    double total() const
+    {
+      return sum_[1];
+    };
+
+    //! Index whose cumulative range contains u (0 <= u < total)
+    unsigned int find(double u) const
+    {
+      unsigned int n = 1;
+      while (n < leaves_)
+        {
+          if (u < sum_[2 * n] || sum_[2 * n + 1] <= 0.0)
+            n = 2 * n;
+          else
+            {
+              u -= sum_[2 * n];
+              n = 2 * n + 1;
+            }
+        }
+      return std::min(n - leaves_, size_ - 1);
+    };
+
+    //! Rebuild the inner nodes from the leaves (after setting them all)
+    void rebuild()
+    {
+      for (unsigned int n = leaves_ - 1; n > 0; n--)
+        sum_[n] = sum_[2 * n] + sum_[2 * n + 1];
+    };
+
+    //! Set a leaf without updating the inner nodes (call rebuild after)
+    void assign(unsigned int i, double v)
+    {
+      if (i >= size_) throw std::out_of_range{"sum tree index out of range"};
+      sum_[leaves_ + i] = v;
+    };
+
+  private:
+    unsigned int        size_;
+    unsigned int        leaves_;
+    std::vector<double> sum_;
+  };
+}
@@ -15,8 +15,13 @@ namespace target
   public:
     //! Create target from data
     Target(unsigned int slot_length, unsigned int days, const std::vector<double> &target)
-      : days_{days}
+      : slot_length_{slot_length}
+      , days_{days}
       , target_{}
+      , minimum_{}
+      , weights_{}
+      , scenarios_{}
+      , scenarios_lambda_{0.0}
       , shift_offset_{0}
       , staff_hours_{}
     {
@@ -30,25 +35,61 @@ namespace target
           throw std::runtime_error{msg.str()};
         }
 
-      unsigned int slots = days * (24 * 60 / slot_length);
-      if (target.size() < slots)
+      target_ = subsample(target);
+    };
+
+    //! Set the minimum staffing curve
+    /*! The minimum curve has the same slot length as the target, at no
+     *  time the planned staffing should fall below it.
+     */
+    void setMinimum(const std::vector<double> &minimum)
+    {
+      minimum_ = subsample(minimum);
+    };
+
+    //! Set the staffing error weights
+    /*! Weights can be given either:
+     *
+     *  - as a curve with the same slot length as the target
+     *  - as a day of week hourly profile (7 * 24 values starting on
+     *    monday at 00:00)
+     *
+     *  the error in each 5 minutes slot is weighted accordingly.
+     */
+    void setWeights(const std::vector<double> &weights)
+    {
+      for (double w : weights)
+        if (w < 0.0) throw std::runtime_error{"staffing weights must be positive"};
+
+      if (weights.size() != 7 * 24)
         {
-          std::stringstream msg;
-          msg << "too few target points, should be at least " << slots << " for " << days << " days and " << slot_length << " minutes slots";
-          throw std::runtime_error{msg.str()};
+          weights_ = subsample(weights);
+          return;
         }
 
-      // subsample
-      unsigned int ratio = slot_length / 5;
-      for (double t : target)
+      weights_.resize(target_.size(), 1.0);
+      for (unsigned int i = 0; i < weights_.size(); i++)
         {
-          for (unsigned int i = 0; i < ratio; i++)
-            target_.push_back(t);
+          unsigned int day  = (i / SLOTS_DAY) % 7;
+          unsigned int hour = (i % SLOTS_DAY) * SLOT_LENGTH / 60;
+          weights_[i]       = weights[day * 24 + hour];
         }
+    };
+
+    //! Set the demand scenarios
+    /*! Each scenario is a perturbed target curve with the same slot
+     *  length as the target, they are used by the robust staffing
+     *  energy (mean plus lambda times the standard deviation of the
+     *  staffing energy over the scenarios).
+     */
+    void setScenarios(const std::vector<std::vector<double>> &scenarios, double lambda)
+    {
+      if (lambda < 0.0) throw std::runtime_error{"scenarios lambda must be positive"};
 
-      // pad target with zeros to the next planning day
-      for (unsigned int n = target_.size() % SLOTS_DAY; n < SLOTS_DAY; n++)
-        target_.push_back(0.0);
+      scenarios_.clear();
+      for (const auto &s : scenarios)
+        scenarios_.push_back(subsample(s));
+      scenarios_lambda_ = lambda;
     };
 
     //! Get length in days
@@ -78,6 +119,47 @@ namespace target
       return target_;
     };
 
+    //! Get minimum staffing curve (zero if not set)
+    const std::vector<double> getMinimum() const
+    {
+      std::vector<double> m{minimum_};
+      m.resize(target_.size(), 0.0);
+      return m;
+    };
+
+    //! Get staffing error weights (one if not set)
+    const std::vector<double> getWeights() const
+    {
+      std::vector<double> w{weights_};
+      w.resize(target_.size(), 1.0);
+      return w;
+    };
+
+    //! Get demand scenarios (with the target size)
+    const std::vector<std::vector<double>> getScenarios() const
+    {
+      std::vector<std::vector<double>> s{scenarios_};
+      for (auto &c : s)
+        c.resize(target_.size(), 0.0);
+      return s;
+    };
+
+    //! Get the robust energy standard deviation factor
+    double getScenariosLambda() const
+    {
+      return scenarios_lambda_;
+    };
+
+    //! Subsample a curve with the target slot length to 5 minutes slots
+    /*! The curve must have the same length as the target.
+     */
+    std::vector<double> resample(const std::vector<double> &curve) const
+    {
+      std::vector<double> s = subsample(curve);
+      if (s.size() != target_.size()) throw std::runtime_error{"curve and target must have the same length"};
+      return s;
+    };
+
     //! Get target performing rescaling if necessary
     const std::vector<double> getTarget() const
     {
@@ -118,11 +200,42 @@ namespace target
     };
 
   private:
+    unsigned int        slot_length_;
     unsigned int        days_;
     std::vector<double> target_;
+    std::vector<double> minimum_;
+    std::vector<double> weights_;
+
+    std::vector<std::vector<double>> scenarios_;
+    double                           scenarios_lambda_;
 
     mutable unsigned int        shift_offset_;
     mutable std::vector<double> staff_hours_;
+
+    // subsample a curve to 5 minutes slots padding it to the next planning day
+    std::vector<double> subsample(const std::vector<double> &curve) const
+    {
+      unsigned int slots = days_ * (24 * 60 / slot_length_);
+      if (curve.size() < slots)
+        {
+          std::stringstream msg;
+          msg << "too few target points, should be at least " << slots << " for " << days_ << " days and " << slot_length_ << " minutes slots";
+          throw std::runtime_error{msg.str()};
+        }
+
+      std::vector<double> s;
+      unsigned int        ratio = slot_length_ / 5;
+      for (double t : curve)
+        {
+          for (unsigned int i = 0; i < ratio; i++)
+            s.push_back(t);
+        }
+
+      // pad with zeros to the next planning day
+      for (unsigned int n = s.size() % SLOTS_DAY; n < SLOTS_DAY; n++)
+        s.push_back(0.0);
+      return s;
+    };
   };
 
   // Stream output
@@ -0,0 +1,64 @@
+"""
+Compile agent rules ahead of time into a C++ header
+
+    python compile_rules.py RULES_MODULE [-o rules.h]
+
+the module defines a dictionary RULES of name -> rule (or (rule, backend)),
+each rule is compiled into the constexpr tables of a struct named after it,
+then building the extension with
+
+    PYWFPLAN_RULES=rules.h python setup.py build_ext
+
+lets the planner load those rules from the tables instead of compiling
+them at start-up (the rules are matched by their hash, backend and
+printed form thus a rule must be built exactly as the planner receives
+it, the others are compiled at start-up), a C++ program can also sample
+them directly with the NAME_fsm sampler (fsm::StaticFsm<NAME>)
+"""
+import sys
+import argparse
+import importlib.util
+
+from pywfplan.pywfplan_ext import compileRule
+
+
+def load_rules(path):
+    """
+    Load the RULES dictionary of a python module
+    """
+    spec = importlib.util.spec_from_file_location("rules", path)
+    module = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(module)
+    if not hasattr(module, "RULES"):
+        raise Exception("{} does not define RULES".format(path))
+    return module.RULES
+
+
+def compile_rules(rules):
+    """
+    Compile the rules into the text of the header
+    """
+    out = ["// generated by tools/compile_rules.py, do not edit",
+           "#pragma once",
+           "",
+           "#include \"fsm_static.h\"",
+           "",
+           "namespace fsm { namespace rules {",
+           ""]
+    for name, rule in rules.items():
+        rule, backend = rule if isinstance(rule, tuple) else (rule, "brzozowski")
+        out.append(compileRule(rule, name, backend))
+    out.append("} }")
+    return "\n".join(out) + "\n"
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Compile agent rules into a C++ header")
+    parser.add_argument("module", help="python module defining RULES")
+    parser.add_argument("-o", "--output", default="rules.h", help="output header")
+    args = parser.parse_args()
+
+    rules = load_rules(args.module)
+    with open(args.output, "w") as f:
+        f.write(compile_rules(rules))
+    print("compiled {} rules into {}".format(len(rules), args.output), file=sys.stderr)